@@ -0,0 +1,429 @@
+#pragma once
+#include <glm/glm.hpp>
+#include <algorithm>
+#include <cassert>
+#include <cfloat>
+#include <cstdint>
+#include <vector>
+
+// Axis aligned bounding box in world space
+struct AABB {
+    glm::vec3 min{ FLT_MAX };
+    glm::vec3 max{ -FLT_MAX };
+
+    AABB() = default;
+    AABB(const glm::vec3& min, const glm::vec3& max) : min(min), max(max) {}
+
+    bool overlaps(const AABB& o) const {
+        return (min.x <= o.max.x && max.x >= o.min.x) &&
+            (min.y <= o.max.y && max.y >= o.min.y) &&
+            (min.z <= o.max.z && max.z >= o.min.z);
+    }
+
+    bool contains(const AABB& o) const {
+        return min.x <= o.min.x && min.y <= o.min.y && min.z <= o.min.z &&
+            max.x >= o.max.x && max.y >= o.max.y && max.z >= o.max.z;
+    }
+
+    float surfaceArea() const {
+        glm::vec3 d = max - min;
+        return 2.0f * (d.x * d.y + d.y * d.z + d.z * d.x);
+    }
+
+    static AABB merge(const AABB& a, const AABB& b) {
+        return AABB(glm::min(a.min, b.min), glm::max(a.max, b.max));
+    }
+};
+
+// Result of testing a box against a volume, e.g. a view frustum
+enum class Containment { Outside, Intersect, Inside };
+
+// Collision layers, an object collides with another only if each one's
+// layer is present in the other's mask
+namespace CollisionLayer {
+    constexpr std::uint32_t None = 0;
+    constexpr std::uint32_t Static = 1u << 0;
+    constexpr std::uint32_t Bot = 1u << 1;
+    constexpr std::uint32_t Projectile = 1u << 2;
+    constexpr std::uint32_t All = 0xFFFFFFFFu;
+}
+
+// Pair of overlapping proxies, reported by their user data
+struct BroadphasePair {
+    std::uint64_t userA;
+    std::uint64_t userB;
+};
+
+// Dynamic AABB tree (incrementally balanced BVH) used as collision broadphase.
+// Leaves store fattened bounds, so a moving object is only reinserted once it
+// leaves its fat box; most frames cost a single containment test per object.
+class DynamicAABBTree {
+public:
+    static constexpr int NullNode = -1;
+
+    float margin = 0.1f;             // fat AABB extension on every side
+    float displacementMultiplier = 2.0f; // predictive extension along movement
+
+    // insert new object, returns proxy id
+    int createProxy(const AABB& aabb, std::uint64_t userData,
+        std::uint32_t layer = CollisionLayer::All, std::uint32_t mask = CollisionLayer::All) {
+        int proxy = allocateNode();
+        Node& n = nodes[proxy];
+        n.tight = aabb;
+        n.fat = AABB(aabb.min - glm::vec3(margin), aabb.max + glm::vec3(margin));
+        n.userData = userData;
+        n.layer = layer;
+        n.mask = mask;
+        n.height = 0;
+        insertLeaf(proxy);
+        ++proxyCount;
+        return proxy;
+    }
+
+    void destroyProxy(int proxy) {
+        assert(proxy >= 0 && proxy < static_cast<int>(nodes.size()) && nodes[proxy].isLeaf());
+        removeLeaf(proxy);
+        freeNode(proxy);
+        --proxyCount;
+    }
+
+    // update object bounds, returns true if the proxy had to be reinserted
+    bool moveProxy(int proxy, const AABB& aabb, const glm::vec3& displacement = glm::vec3(0.0f)) {
+        assert(proxy >= 0 && proxy < static_cast<int>(nodes.size()) && nodes[proxy].isLeaf());
+        nodes[proxy].tight = aabb;
+        if (nodes[proxy].fat.contains(aabb)) return false;
+
+        removeLeaf(proxy);
+
+        AABB fat(aabb.min - glm::vec3(margin), aabb.max + glm::vec3(margin));
+        glm::vec3 d = displacement * displacementMultiplier;
+        for (int i = 0; i < 3; ++i) {
+            if (d[i] < 0.0f) fat.min[i] += d[i];
+            else fat.max[i] += d[i];
+        }
+        nodes[proxy].fat = fat;
+
+        insertLeaf(proxy);
+        return true;
+    }
+
+    void setFilter(int proxy, std::uint32_t layer, std::uint32_t mask) {
+        nodes[proxy].layer = layer;
+        nodes[proxy].mask = mask;
+    }
+
+    const AABB& getFatAABB(int proxy) const { return nodes[proxy].fat; }
+    const AABB& getAABB(int proxy) const { return nodes[proxy].tight; }
+    std::uint64_t getUserData(int proxy) const { return nodes[proxy].userData; }
+    std::uint32_t getLayer(int proxy) const { return nodes[proxy].layer; }
+    int getProxyCount() const { return proxyCount; }
+    int getHeight() const { return root == NullNode ? 0 : nodes[root].height; }
+
+    // visit every proxy whose fat box overlaps aabb
+    // callback(int proxy) returns false to stop the query
+    template<typename Callback>
+    void query(const AABB& aabb, Callback&& callback) const {
+        if (root == NullNode) return;
+        int stack[MaxStack];
+        int top = 0;
+        stack[top++] = root;
+        while (top > 0) {
+            int index = stack[--top];
+            const Node& n = nodes[index];
+            if (!n.fat.overlaps(aabb)) continue;
+            if (n.isLeaf()) {
+                if (!callback(index)) return;
+            }
+            else {
+                assert(top + 2 <= MaxStack);
+                stack[top++] = n.child1;
+                stack[top++] = n.child2;
+            }
+        }
+    }
+
+    // visit every proxy whose fat box is not rejected by a volume test;
+    // classify(const AABB&) returns a Containment, subtrees fully inside are
+    // reported without testing their nodes. callback(int proxy, bool inside)
+    template<typename Classify, typename Callback>
+    void cull(Classify&& classify, Callback&& callback) const {
+        if (root == NullNode) return;
+        int stack[MaxStack];
+        int top = 0;
+        stack[top++] = root;
+        while (top > 0) {
+            int index = stack[--top];
+            const Node& n = nodes[index];
+            Containment c = classify(n.fat);
+            if (c == Containment::Outside) continue;
+            if (c == Containment::Inside) {
+                reportLeaves(index, callback);
+                continue;
+            }
+            if (n.isLeaf()) {
+                callback(index, false);
+            }
+            else {
+                assert(top + 2 <= MaxStack);
+                stack[top++] = n.child1;
+                stack[top++] = n.child2;
+            }
+        }
+    }
+
+    // collect all pairs of proxies whose exact bounds overlap and whose
+    // layer/mask filters accept each other; every pair is reported once
+    void computePairs(std::vector<BroadphasePair>& pairs) const {
+        pairs.clear();
+        for (int i = 0; i < static_cast<int>(nodes.size()); ++i) {
+            const Node& a = nodes[i];
+            if (!a.isLeaf() || a.mask == CollisionLayer::None) continue;
+            query(a.tight, [&](int j) {
+                const Node& b = nodes[j];
+                if (j <= i) return true; // reported from the other side (or self)
+                if (!(a.layer & b.mask) || !(b.layer & a.mask)) return true;
+                if (a.tight.overlaps(b.tight)) pairs.push_back({ a.userData, b.userData });
+                return true;
+            });
+        }
+    }
+
+private:
+    static constexpr int MaxStack = 128; // balanced tree, height stays far below this
+
+    struct Node {
+        AABB fat;                  // enlarged bounds (leaf) or union of children
+        AABB tight;                // exact bounds, leaves only
+        std::uint64_t userData = 0;
+        int parent = NullNode;     // next free node while in the free list
+        int child1 = NullNode;
+        int child2 = NullNode;
+        int height = -1;           // leaf = 0, free node = -1
+        std::uint32_t layer = CollisionLayer::All;
+        std::uint32_t mask = CollisionLayer::All;
+
+        bool isLeaf() const { return height == 0; }
+    };
+
+    std::vector<Node> nodes;
+    int root = NullNode;
+    int freeList = NullNode;
+    int proxyCount = 0;
+
+    int allocateNode() {
+        if (freeList == NullNode) {
+            nodes.emplace_back();
+            freeList = static_cast<int>(nodes.size()) - 1;
+            nodes[freeList].parent = NullNode;
+        }
+        int index = freeList;
+        freeList = nodes[index].parent;
+        nodes[index] = Node{};
+        nodes[index].height = 0;
+        return index;
+    }
+
+    void freeNode(int index) {
+        nodes[index].parent = freeList;
+        nodes[index].height = -1;
+        freeList = index;
+    }
+
+    void insertLeaf(int leaf) {
+        if (root == NullNode) {
+            root = leaf;
+            nodes[root].parent = NullNode;
+            return;
+        }
+
+        // find the best sibling using the surface area heuristic
+        AABB leafAABB = nodes[leaf].fat;
+        int index = root;
+        while (!nodes[index].isLeaf()) {
+            const Node& n = nodes[index];
+            float area = n.fat.surfaceArea();
+            float combinedArea = AABB::merge(n.fat, leafAABB).surfaceArea();
+
+            // cost of creating a new parent for this node and the new leaf
+            float cost = 2.0f * combinedArea;
+            // minimum cost of pushing the leaf further down the tree
+            float inheritanceCost = 2.0f * (combinedArea - area);
+
+            auto descendCost = [&](int child) {
+                const Node& c = nodes[child];
+                float merged = AABB::merge(leafAABB, c.fat).surfaceArea();
+                return c.isLeaf() ? merged + inheritanceCost
+                    : (merged - c.fat.surfaceArea()) + inheritanceCost;
+            };
+            float cost1 = descendCost(n.child1);
+            float cost2 = descendCost(n.child2);
+
+            if (cost < cost1 && cost < cost2) break;
+            index = (cost1 < cost2) ? n.child1 : n.child2;
+        }
+
+        int sibling = index;
+        int oldParent = nodes[sibling].parent;
+        int newParent = allocateNode(); // may reallocate nodes
+        nodes[newParent].parent = oldParent;
+        nodes[newParent].fat = AABB::merge(leafAABB, nodes[sibling].fat);
+        nodes[newParent].height = nodes[sibling].height + 1;
+        nodes[newParent].child1 = sibling;
+        nodes[newParent].child2 = leaf;
+        nodes[sibling].parent = newParent;
+        nodes[leaf].parent = newParent;
+
+        if (oldParent != NullNode) {
+            if (nodes[oldParent].child1 == sibling) nodes[oldParent].child1 = newParent;
+            else nodes[oldParent].child2 = newParent;
+        }
+        else {
+            root = newParent;
+        }
+
+        refitUpwards(nodes[leaf].parent);
+    }
+
+    void removeLeaf(int leaf) {
+        if (leaf == root) {
+            root = NullNode;
+            return;
+        }
+
+        int parent = nodes[leaf].parent;
+        int grandParent = nodes[parent].parent;
+        int sibling = (nodes[parent].child1 == leaf) ? nodes[parent].child2 : nodes[parent].child1;
+
+        if (grandParent != NullNode) {
+            // connect sibling to grandparent, drop the parent
+            if (nodes[grandParent].child1 == parent) nodes[grandParent].child1 = sibling;
+            else nodes[grandParent].child2 = sibling;
+            nodes[sibling].parent = grandParent;
+            freeNode(parent);
+            refitUpwards(grandParent);
+        }
+        else {
+            root = sibling;
+            nodes[sibling].parent = NullNode;
+            freeNode(parent);
+        }
+    }
+
+    // rebalance and recompute bounds from index up to the root
+    void refitUpwards(int index) {
+        while (index != NullNode) {
+            index = balance(index);
+            Node& n = nodes[index];
+            n.height = 1 + std::max(nodes[n.child1].height, nodes[n.child2].height);
+            n.fat = AABB::merge(nodes[n.child1].fat, nodes[n.child2].fat);
+            index = n.parent;
+        }
+    }
+
+    // AVL style tree rotation, returns index of the new subtree root
+    int balance(int iA) {
+        Node& A = nodes[iA];
+        if (A.isLeaf() || A.height < 2) return iA;
+
+        int iB = A.child1;
+        int iC = A.child2;
+        Node& B = nodes[iB];
+        Node& C = nodes[iC];
+        int diff = C.height - B.height;
+
+        // rotate C up
+        if (diff > 1) {
+            int iF = C.child1;
+            int iG = C.child2;
+            Node& F = nodes[iF];
+            Node& G = nodes[iG];
+
+            C.child1 = iA;
+            C.parent = A.parent;
+            A.parent = iC;
+            replaceChild(C.parent, iA, iC);
+
+            if (F.height > G.height) {
+                C.child2 = iF;
+                A.child2 = iG;
+                G.parent = iA;
+                A.fat = AABB::merge(B.fat, G.fat);
+                C.fat = AABB::merge(A.fat, F.fat);
+                A.height = 1 + std::max(B.height, G.height);
+                C.height = 1 + std::max(A.height, F.height);
+            }
+            else {
+                C.child2 = iG;
+                A.child2 = iF;
+                F.parent = iA;
+                A.fat = AABB::merge(B.fat, F.fat);
+                C.fat = AABB::merge(A.fat, G.fat);
+                A.height = 1 + std::max(B.height, F.height);
+                C.height = 1 + std::max(A.height, G.height);
+            }
+            return iC;
+        }
+
+        // rotate B up
+        if (diff < -1) {
+            int iD = B.child1;
+            int iE = B.child2;
+            Node& D = nodes[iD];
+            Node& E = nodes[iE];
+
+            B.child1 = iA;
+            B.parent = A.parent;
+            A.parent = iB;
+            replaceChild(B.parent, iA, iB);
+
+            if (D.height > E.height) {
+                B.child2 = iD;
+                A.child1 = iE;
+                E.parent = iA;
+                A.fat = AABB::merge(C.fat, E.fat);
+                B.fat = AABB::merge(A.fat, D.fat);
+                A.height = 1 + std::max(C.height, E.height);
+                B.height = 1 + std::max(A.height, D.height);
+            }
+            else {
+                B.child2 = iE;
+                A.child1 = iD;
+                D.parent = iA;
+                A.fat = AABB::merge(C.fat, D.fat);
+                B.fat = AABB::merge(A.fat, E.fat);
+                A.height = 1 + std::max(C.height, D.height);
+                B.height = 1 + std::max(A.height, E.height);
+            }
+            return iB;
+        }
+
+        return iA;
+    }
+
+    // every leaf below index, no tests
+    template<typename Callback>
+    void reportLeaves(int index, Callback& callback) const {
+        int stack[MaxStack];
+        int top = 0;
+        stack[top++] = index;
+        while (top > 0) {
+            const Node& n = nodes[stack[--top]];
+            if (n.isLeaf()) {
+                callback(static_cast<int>(&n - nodes.data()), true);
+                continue;
+            }
+            assert(top + 2 <= MaxStack);
+            stack[top++] = n.child1;
+            stack[top++] = n.child2;
+        }
+    }
+
+    void replaceChild(int parent, int oldChild, int newChild) {
+        if (parent == NullNode) {
+            root = newChild;
+            return;
+        }
+        if (nodes[parent].child1 == oldChild) nodes[parent].child1 = newChild;
+        else nodes[parent].child2 = newChild;
+    }
+};
@@ -1,5 +1,7 @@
 #pragma once
 #include "Entity.hpp"
+#include "BehaviorTask.hpp"
+#include "FlowField.hpp"
 #include <glm/glm.hpp>
 #include <cmath>
 #include <functional>
@@ -38,14 +40,37 @@ namespace Behaviors {
         };
     }
 
+    // Coroutine version of FollowCamera: while the camera is close the task only
+    // checks the distance every checkInterval seconds. With a planner the bot
+    // walks the flow field (goal = camera) instead of a straight line.
+    inline BehaviorTask FollowCameraTask(Entity& self, const FlowFieldPlanner* planner = nullptr,
+        float minDistance = 2.0f, float speed = 0.5f, float checkInterval = 0.1f) {
+        if (self.camera == nullptr) co_return;
+        auto far = [&self, minDistance] { return glm::distance(self.camera->position, self.position) >= minDistance; };
+        for (;;) {
+            co_await until(far, checkInterval);
+            while (far()) {
+                if (planner && planner->ready()) {
+                    glm::vec3 dir = planner->sample(self.position);
+                    self.velocity.x = dir.x * speed;
+                    self.velocity.z = dir.z * speed;
+                }
+                else {
+                    self.setSpeed(glm::normalize(self.camera->position - self.position) * speed);
+                }
+                co_await nextTick();
+            }
+            self.setSpeed(glm::vec3(0));
+        }
+    }
+
     // Bob up and down
     inline Behavior Bob(float amplitude = 0.5f, float speed = 1.0f) {
 		std::cout << "Bob behavior initialized with amplitude: " << amplitude << " and speed: " << speed << std::endl;
-        float baseY = 0.0f;
-        bool first = true;
+        float time = 0.0f; // simulation time, not wall clock, so it also runs headless
         return [=](Entity& self, float dt) mutable {
-            if (first) { first = false; }
-            self.updatePos(0, static_cast<float>(sin(glfwGetTime() * speed) * amplitude), 0);
+            time += dt;
+            self.updatePos(0, static_cast<float>(sin(time * speed) * amplitude), 0);
             };
     }
 
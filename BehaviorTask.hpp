@@ -0,0 +1,276 @@
+#pragma once
+#include <coroutine>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <queue>
+#include <utility>
+#include <vector>
+
+class BehaviorScheduler;
+
+// Coroutine behavior script. A suspended task sits in one of the scheduler
+// queues and is not touched until it is due, so idle scripts cost nothing.
+//
+//     BehaviorTask Patrol(Entity& self) {
+//         for (;;) {
+//             co_await Behaviors::delay(2.0f);
+//             ...
+//         }
+//     }
+//
+// Tasks can also co_await other tasks, the caller resumes when the callee
+// returns and an exception of the callee is rethrown in the caller. An
+// exception leaving a root task ends it and is rethrown by update().
+class BehaviorTask {
+public:
+    struct promise_type;
+    using Handle = std::coroutine_handle<promise_type>;
+
+    struct promise_type {
+        BehaviorScheduler* scheduler = nullptr;
+        Handle root;                             // task owned by the scheduler
+        std::coroutine_handle<> continuation;    // awaiting parent of a nested task
+        std::size_t slot = 0;                    // index in the scheduler task list (roots)
+        std::exception_ptr exception;            // escaped the body, rethrown by the awaiter
+
+        BehaviorTask get_return_object() { return BehaviorTask(Handle::from_promise(*this)); }
+        std::suspend_always initial_suspend() noexcept { return {}; }
+
+        // nested tasks hand control straight back to their parent
+        struct FinalAwaiter {
+            bool await_ready() noexcept { return false; }
+            std::coroutine_handle<> await_suspend(Handle h) noexcept {
+                auto next = h.promise().continuation;
+                return next ? next : std::noop_coroutine();
+            }
+            void await_resume() noexcept {}
+        };
+        FinalAwaiter final_suspend() noexcept { return {}; }
+
+        void return_void() {}
+        // kept by the task itself: a task that was never spawned or awaited has no root
+        void unhandled_exception() { exception = std::current_exception(); }
+    };
+
+    BehaviorTask() = default;
+    explicit BehaviorTask(Handle h) : handle(h) {}
+    BehaviorTask(BehaviorTask&& other) noexcept : handle(std::exchange(other.handle, {})) {}
+    BehaviorTask& operator=(BehaviorTask&& other) noexcept {
+        if (this != &other) {
+            if (handle) handle.destroy();
+            handle = std::exchange(other.handle, {});
+        }
+        return *this;
+    }
+    BehaviorTask(const BehaviorTask&) = delete;
+    BehaviorTask& operator=(const BehaviorTask&) = delete;
+    ~BehaviorTask() { if (handle) handle.destroy(); }
+
+    // co_await of a nested task: runs it right away with the parent's scheduler
+    bool await_ready() const noexcept { return !handle || handle.done(); }
+    std::coroutine_handle<> await_suspend(Handle parent) noexcept {
+        promise_type& p = handle.promise();
+        p.scheduler = parent.promise().scheduler;
+        p.root = parent.promise().root;
+        p.continuation = parent;
+        return handle;
+    }
+    void await_resume() const {
+        if (handle && handle.promise().exception) std::rethrow_exception(handle.promise().exception);
+    }
+
+private:
+    friend class BehaviorScheduler;
+    Handle handle;
+};
+
+// One-shot signal, tasks waiting on it are resumed on the tick after signal().
+class BehaviorEvent {
+public:
+    void signal();
+    void reset() { signaled = false; }
+    bool isSignaled() const { return signaled; }
+
+    bool await_ready() const noexcept { return signaled; }
+    void await_suspend(BehaviorTask::Handle h) { waiters.push_back(h); }
+    void await_resume() const noexcept {}
+
+private:
+    bool signaled = false;
+    std::vector<BehaviorTask::Handle> waiters;
+};
+
+// Runs behavior tasks on the simulation tick. Tasks waiting for the next tick
+// are kept in a list, delayed ones in a timer heap ordered by wake time and
+// conditions are either polled every tick or on their own interval through
+// the timer heap. Only due tasks are resumed.
+class BehaviorScheduler {
+public:
+    BehaviorScheduler() = default;
+    BehaviorScheduler(const BehaviorScheduler&) = delete;
+    BehaviorScheduler& operator=(const BehaviorScheduler&) = delete;
+    ~BehaviorScheduler() { clear(); }
+
+    // takes ownership, the task starts on the next update
+    void spawn(BehaviorTask task) {
+        BehaviorTask::Handle h = std::exchange(task.handle, {});
+        if (!h) return;
+        auto& p = h.promise();
+        p.scheduler = this;
+        p.root = h;
+        p.slot = tasks.size();
+        tasks.push_back(h);
+        nextTick.push_back(h);
+    }
+
+    // resume every task that is due at the current time
+    void update(float dt) {
+        deltaTime = dt;
+        time += dt;
+
+        ready.clear();
+        std::swap(ready, nextTick);
+
+        while (!timers.empty() && timers.top().wake <= time) {
+            Timer timer = timers.top();
+            timers.pop();
+            if (timer.condition && !timer.condition()) {
+                timer.wake = time + timer.interval;
+                timer.order = timerOrder++;
+                timers.push(std::move(timer));
+                continue;
+            }
+            ready.push_back(timer.handle);
+        }
+
+        // conditions polled every tick, satisfied ones are removed by swap
+        for (std::size_t i = 0; i < waiters.size();) {
+            if (waiters[i].first()) {
+                ready.push_back(waiters[i].second);
+                waiters[i] = std::move(waiters.back());
+                waiters.pop_back();
+            }
+            else {
+                ++i;
+            }
+        }
+
+        // every due task runs even if one fails, the first failure is rethrown after
+        std::exception_ptr failure;
+        for (auto h : ready) {
+            std::exception_ptr exception = resume(h);
+            if (exception && !failure) failure = exception;
+        }
+        if (failure) std::rethrow_exception(failure);
+    }
+
+    // destroys every task, also the suspended ones
+    void clear() {
+        for (auto h : tasks) h.destroy();
+        tasks.clear();
+        nextTick.clear();
+        ready.clear();
+        waiters.clear();
+        timers = {};
+    }
+
+    std::size_t size() const { return tasks.size(); }
+    std::size_t resumedLastUpdate() const { return ready.size(); }
+    double getTime() const { return time; }
+    float getDeltaTime() const { return deltaTime; }
+
+    // used by the awaitables
+    void scheduleNextTick(BehaviorTask::Handle h) { nextTick.push_back(h); }
+    void scheduleAt(BehaviorTask::Handle h, double wake, std::function<bool()> condition = {}, float interval = 0.0f) {
+        timers.push(Timer{ wake, timerOrder++, h, std::move(condition), interval });
+    }
+    void scheduleWhen(BehaviorTask::Handle h, std::function<bool()> condition) {
+        waiters.emplace_back(std::move(condition), h);
+    }
+
+private:
+    struct Timer {
+        double wake;
+        std::uint64_t order;              // keeps equal wake times in FIFO order
+        BehaviorTask::Handle handle;
+        std::function<bool()> condition;  // re-armed every interval until true
+        float interval;
+
+        bool operator>(const Timer& o) const { return wake != o.wake ? wake > o.wake : order > o.order; }
+    };
+
+    std::vector<BehaviorTask::Handle> tasks;       // owned root tasks
+    std::vector<BehaviorTask::Handle> nextTick;
+    std::vector<BehaviorTask::Handle> ready;
+    std::vector<std::pair<std::function<bool()>, BehaviorTask::Handle>> waiters;
+    std::priority_queue<Timer, std::vector<Timer>, std::greater<Timer>> timers;
+    std::uint64_t timerOrder = 0;
+    double time = 0.0;
+    float deltaTime = 0.0f;
+
+    // returns the exception that ended the root task, if any
+    std::exception_ptr resume(BehaviorTask::Handle h) {
+        // h may be a nested task that is destroyed by its parent while resuming
+        BehaviorTask::Handle root = h.promise().root;
+        h.resume();
+        if (!root.done()) return {};
+
+        std::exception_ptr exception = root.promise().exception;
+        // swap remove from the task list
+        std::size_t slot = root.promise().slot;
+        tasks[slot] = tasks.back();
+        tasks[slot].promise().slot = slot;
+        tasks.pop_back();
+        root.destroy();
+        return exception;
+    }
+};
+
+inline void BehaviorEvent::signal() {
+    signaled = true;
+    for (auto h : waiters) h.promise().scheduler->scheduleNextTick(h);
+    waiters.clear();
+}
+
+namespace Behaviors {
+
+    // resume on the next simulation tick, yields the tick length
+    struct NextTick {
+        BehaviorScheduler* scheduler = nullptr;
+        bool await_ready() const noexcept { return false; }
+        void await_suspend(BehaviorTask::Handle h) {
+            scheduler = h.promise().scheduler;
+            scheduler->scheduleNextTick(h);
+        }
+        float await_resume() const noexcept { return scheduler->getDeltaTime(); }
+    };
+    inline NextTick nextTick() { return {}; }
+
+    // resume after the given simulation time has passed
+    struct Delay {
+        float seconds;
+        bool await_ready() const noexcept { return seconds <= 0.0f; }
+        void await_suspend(BehaviorTask::Handle h) {
+            auto* s = h.promise().scheduler;
+            s->scheduleAt(h, s->getTime() + seconds);
+        }
+        void await_resume() const noexcept {}
+    };
+    inline Delay delay(float seconds) { return { seconds }; }
+
+    // resume once condition() holds; interval 0 polls every tick, otherwise
+    // the condition is checked only every interval seconds
+    struct Until {
+        std::function<bool()> condition;
+        float interval;
+        bool await_ready() const { return condition(); }
+        void await_suspend(BehaviorTask::Handle h) {
+            auto* s = h.promise().scheduler;
+            if (interval > 0.0f) s->scheduleAt(h, s->getTime() + interval, std::move(condition), interval);
+            else s->scheduleWhen(h, std::move(condition));
+        }
+        void await_resume() const noexcept {}
+    };
+    inline Until until(std::function<bool()> condition, float interval = 0.0f) { return { std::move(condition), interval }; }
+}
@@ -0,0 +1,327 @@
+#pragma once
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <glm/ext.hpp>
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include "AABBTree.hpp"
+#include "Culling.hpp"
+#include "Mesh.hpp"
+#include "Model.hpp"
+#include "ShaderProgram.hpp"
+#include "SlotMap.hpp"
+
+// Cascaded shadow maps of the sun. The view frustum up to a shadow distance
+// is split into cascades, each covered by an orthographic light view of the
+// bounding sphere of its slice; the sphere size does not change with the
+// camera rotation and its center is snapped to a coarse grid of whole texels,
+// so a cascade only changes when the camera has moved a fraction of it.
+//
+// Static meshes (terrain) are rendered into a cache per cascade that is kept
+// until the cascade changes; dynamic models are drawn on top of a copy of it.
+// The light direction follows the sun only when it has turned past an angle,
+// and with staggering the far cascades are refreshed every second or fourth
+// frame. Shaders read the matrices each cascade was last rendered with, a
+// point outside a cascade falls through to the next one.
+class CascadedShadows {
+public:
+    static constexpr int MaxCascades = 4;
+    static constexpr GLuint ShadowBinding = 2;   // uniform block, must match tex.frag
+    static constexpr GLuint ShadowUnit = 5;      // texture unit of shadowMap
+
+    struct Settings {
+        int cascades = 4;            // 0 disables shadows
+        int resolution = 2048;       // texels per side of a cascade
+        float distance = 60.0f;      // shadowed view depth
+        float splitLambda = 0.8f;    // logarithmic vs linear splits
+        float sunThreshold = glm::radians(0.5f);   // sun turn that moves the light
+        float casterHeight = 10.0f;  // room above the static bounds for casters
+        bool stagger = true;         // far cascades not every frame
+    };
+
+    struct Stats {
+        int cascades = 0;   // rendered this frame
+        int statics = 0;    // of those with the static cache rebuilt
+    };
+
+    Stats stats;
+
+    CascadedShadows() = default;
+    CascadedShadows(const CascadedShadows&) = delete;
+    CascadedShadows& operator=(const CascadedShadows&) = delete;
+    ~CascadedShadows() { clear(); }
+
+    // needs a GL context; the uniform block exists even without shadows
+    void init(const Settings& s) {
+        settings = s;
+        settings.cascades = std::clamp(settings.cascades, 0, MaxCascades);
+        settings.resolution = std::max(settings.resolution, 16);
+        glCreateBuffers(1, &uniformBuffer);
+        block = Block{};
+        glNamedBufferData(uniformBuffer, sizeof(Block), &block, GL_DYNAMIC_DRAW);
+        if (!ready()) return;
+
+        depthProgram = ShaderProgram("resources/shaders/shadow_depth.vert", "resources/shaders/depth_only.frag");
+        int res = settings.resolution;
+        glCreateTextures(GL_TEXTURE_2D_ARRAY, 1, &maps);
+        glTextureStorage3D(maps, 1, GL_DEPTH_COMPONENT32F, res, res, settings.cascades);
+        glTextureParameteri(maps, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTextureParameteri(maps, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTextureParameteri(maps, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTextureParameteri(maps, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTextureParameteri(maps, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+        glTextureParameteri(maps, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+        // only copied from, never sampled
+        glCreateTextures(GL_TEXTURE_2D_ARRAY, 1, &staticMaps);
+        glTextureStorage3D(staticMaps, 1, GL_DEPTH_COMPONENT32F, res, res, settings.cascades);
+
+        glCreateFramebuffers(1, &framebuffer);
+        glNamedFramebufferDrawBuffer(framebuffer, GL_NONE);
+        glNamedFramebufferReadBuffer(framebuffer, GL_NONE);
+    }
+
+    bool ready() const { return settings.cascades > 0 && uniformBuffer != 0; }
+
+    // every mesh of a model that never moves, cached in the static layers
+    void addStatic(Model& model) {
+        model.updateAABBAndModelMatrix();
+        for (Mesh& mesh : model.meshes) {
+            AABB local;
+            for (const Vertex& v : mesh.vertices) {
+                local.min = glm::min(local.min, v.position);
+                local.max = glm::max(local.max, v.position);
+            }
+            AABB bounds = SceneCuller::transform(local, model.modelMatrix);
+            staticMeshes.push_back({ &mesh, model.modelMatrix, bounds });
+            staticBounds.min = glm::min(staticBounds.min, bounds.min);
+            staticBounds.max = glm::max(staticBounds.max, bounds.max);
+        }
+        for (Cascade& c : cascades) c.valid = false;
+    }
+
+    // refresh the cascades due this frame for a camera (fov in radians) and
+    // the current sun direction, opaque models of the scene cast shadows
+    void update(const glm::mat4& view, float fov, float aspect, float nearPlane,
+        const glm::vec3& sunDirection, SlotMap<Model>& scene) {
+        stats = Stats{};
+        if (!ready()) {
+            bind();
+            return;
+        }
+        ++frame;
+        GLint viewport[4], target = 0;
+        glGetIntegerv(GL_VIEWPORT, viewport);
+        glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &target);
+
+        glm::vec3 sun = glm::normalize(sunDirection);
+        if (direction == 0 || glm::dot(sun, lightDirection) < std::cos(settings.sunThreshold)) {
+            lightDirection = sun;
+            ++direction;
+            lightView = glm::lookAt(glm::vec3(0.0f), lightDirection,
+                std::abs(lightDirection.y) > 0.99f ? glm::vec3(1.0f, 0.0f, 0.0f) : glm::vec3(0.0f, 1.0f, 0.0f));
+            depthRange();
+        }
+
+        glm::mat4 cameraToWorld = glm::inverse(view);
+        float tanY = std::tan(fov * 0.5f);
+        float tanX = tanY * aspect;
+        float sliceNear = nearPlane;
+        bool changed = false;
+        for (int i = 0; i < settings.cascades; ++i) {
+            float sliceFar = split(i + 1, nearPlane);
+            float from = sliceNear;
+            sliceNear = sliceFar;
+            Cascade& cascade = cascades[i];
+            if (cascade.valid && !due(i)) continue;
+
+            // bounding sphere of the frustum slice, the radius is rounded so it stays put
+            glm::vec3 corners[8];
+            glm::vec3 center(0.0f);
+            for (int k = 0; k < 8; ++k) {
+                float z = (k & 4) ? sliceFar : from;
+                glm::vec3 p(((k & 1) ? 1.0f : -1.0f) * tanX * z, ((k & 2) ? 1.0f : -1.0f) * tanY * z, -z);
+                corners[k] = glm::vec3(cameraToWorld * glm::vec4(p, 1.0f));
+                center += corners[k] * 0.125f;
+            }
+            float radius = 0.0f;
+            for (const glm::vec3& p : corners) radius = std::max(radius, glm::length(p - center));
+            radius = std::ceil(radius * 16.0f) / 16.0f;
+
+            // the center moves in steps of a tenth of the map, the margin keeps the sphere inside
+            float halfSize = radius * 1.25f;
+            float texel = 2.0f * halfSize / settings.resolution;
+            float grid = std::max(std::floor(settings.resolution / 10.0f), 1.0f) * texel;
+            glm::vec3 c = glm::vec3(lightView * glm::vec4(center, 1.0f));
+            glm::ivec2 cell(static_cast<int>(std::floor(c.x / grid + 0.5f)), static_cast<int>(std::floor(c.y / grid + 0.5f)));
+            glm::vec2 snapped = glm::vec2(cell) * grid;
+            float zNear = nearZ, zFar = farZ;
+            if (staticMeshes.empty()) {
+                zNear = -c.z - halfSize - settings.casterHeight;
+                zFar = -c.z + halfSize;
+            }
+            glm::mat4 matrix = glm::ortho(snapped.x - halfSize, snapped.x + halfSize,
+                snapped.y - halfSize, snapped.y + halfSize, zNear, zFar) * lightView;
+
+            if (!cascade.valid || cascade.direction != direction || cascade.cell != cell || cascade.halfSize != halfSize) {
+                renderStatic(i, matrix);
+                ++stats.statics;
+            }
+            renderDynamic(i, matrix, scene);
+            ++stats.cascades;
+
+            cascade.valid = true;
+            cascade.direction = direction;
+            cascade.cell = cell;
+            cascade.halfSize = halfSize;
+            block.matrices[i] = matrix;
+            block.texels[i] = texel;
+            changed = true;
+        }
+
+        if (changed) {
+            block.params = glm::vec4(static_cast<float>(settings.cascades), 0.0005f, 0.0f, 0.0f);
+            glNamedBufferSubData(uniformBuffer, 0, sizeof(Block), &block);
+            glBindFramebuffer(GL_FRAMEBUFFER, target);
+            glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+        }
+        bind();
+    }
+
+    // uniform block and maps for every program reading the shadows
+    void bind() const {
+        glBindBufferBase(GL_UNIFORM_BUFFER, ShadowBinding, uniformBuffer);
+        glBindTextureUnit(ShadowUnit, maps);
+    }
+
+    void clear() {
+        if (maps) glDeleteTextures(1, &maps);
+        if (staticMaps) glDeleteTextures(1, &staticMaps);
+        if (framebuffer) glDeleteFramebuffers(1, &framebuffer);
+        if (uniformBuffer) glDeleteBuffers(1, &uniformBuffer);
+        maps = staticMaps = framebuffer = uniformBuffer = 0;
+        depthProgram.clear();
+        for (Cascade& c : cascades) c.valid = false;
+    }
+
+private:
+    struct Cascade {
+        bool valid = false;
+        std::uint64_t direction = 0;   // light direction rendered with
+        glm::ivec2 cell{ 0 };          // snapped light space center
+        float halfSize = 0.0f;
+    };
+    struct StaticMesh {
+        Mesh* mesh;
+        glm::mat4 model;
+        AABB bounds;
+    };
+    // std140, matrices of the last render of each cascade
+    struct Block {
+        glm::mat4 matrices[MaxCascades]{};
+        glm::vec4 texels{ 0.0f };   // world size of a texel per cascade
+        glm::vec4 params{ 0.0f };   // x = cascades, y = depth bias
+    };
+
+    Settings settings;
+    ShaderProgram depthProgram;
+    GLuint maps = 0, staticMaps = 0, framebuffer = 0, uniformBuffer = 0;
+    Cascade cascades[MaxCascades];
+    Block block;
+    std::vector<StaticMesh> staticMeshes;
+    AABB staticBounds;
+    glm::vec3 lightDirection{ 0.0f, -1.0f, 0.0f };
+    glm::mat4 lightView{ 1.0f };
+    std::uint64_t direction = 0;   // bumped when the light direction moves
+    std::uint64_t frame = 0;
+    float nearZ = 0.0f, farZ = 1.0f;   // ortho depth range over the static bounds
+
+    // practical split scheme: blend of logarithmic and uniform distances
+    float split(int i, float nearPlane) const {
+        float t = static_cast<float>(i) / settings.cascades;
+        float logarithmic = nearPlane * std::pow(settings.distance / nearPlane, t);
+        float uniform = nearPlane + (settings.distance - nearPlane) * t;
+        return settings.splitLambda * logarithmic + (1.0f - settings.splitLambda) * uniform;
+    }
+
+    // cascade 0 every frame, 1 every other frame, the rest every fourth frame
+    // on alternating frames, so at most two cascades are drawn per frame
+    bool due(int i) const {
+        if (!settings.stagger || i == 0) return true;
+        if (i == 1) return frame % 2 == 0;
+        return frame % 4 == (i == 2 ? 1u : 3u);
+    }
+
+    // light space depth of the static bounds and the caster room above them
+    void depthRange() {
+        if (staticMeshes.empty()) return;
+        AABB box = staticBounds;
+        box.max.y += settings.casterHeight;
+        float lo = FLT_MAX, hi = -FLT_MAX;
+        for (int k = 0; k < 8; ++k) {
+            glm::vec3 p((k & 1) ? box.max.x : box.min.x, (k & 2) ? box.max.y : box.min.y, (k & 4) ? box.max.z : box.min.z);
+            float z = (lightView * glm::vec4(p, 1.0f)).z;
+            lo = std::min(lo, z);
+            hi = std::max(hi, z);
+        }
+        // the light looks down -z
+        nearZ = -hi - 1.0f;
+        farZ = -lo + 1.0f;
+    }
+
+    // bind layer i of a map array, casters beyond the depth range are clamped
+    void beginLayer(GLuint texture, int layer, const glm::mat4& matrix) {
+        glNamedFramebufferTextureLayer(framebuffer, GL_DEPTH_ATTACHMENT, texture, 0, layer);
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        glViewport(0, 0, settings.resolution, settings.resolution);
+        glDisable(GL_CULL_FACE);
+        glEnable(GL_DEPTH_CLAMP);
+        glEnable(GL_POLYGON_OFFSET_FILL);
+        glPolygonOffset(1.5f, 2.0f);
+        depthProgram.activate();
+        depthProgram.setUniform("uLightVP", matrix);
+    }
+
+    void endLayer() {
+        depthProgram.deactivate();
+        glBindVertexArray(0);
+        glDisable(GL_POLYGON_OFFSET_FILL);
+        glDisable(GL_DEPTH_CLAMP);
+        glEnable(GL_CULL_FACE);
+    }
+
+    void drawMesh(const Mesh& mesh, const glm::mat4& model) {
+        depthProgram.setUniform("uM_m", model);
+        glBindVertexArray(mesh.getVAO());
+        glDrawElements(mesh.primitive_type, static_cast<GLsizei>(mesh.indices.size()), GL_UNSIGNED_INT, 0);
+    }
+
+    void renderStatic(int i, const glm::mat4& matrix) {
+        Frustum frustum = Frustum::fromMatrix(matrix);
+        beginLayer(staticMaps, i, matrix);
+        const float far = 1.0f;
+        glClearNamedFramebufferfv(framebuffer, GL_DEPTH, 0, &far);
+        for (const StaticMesh& s : staticMeshes) {
+            if (frustum.visible(s.bounds)) drawMesh(*s.mesh, s.model);
+        }
+        endLayer();
+    }
+
+    // cached static depth plus the shadow casting models drawn over it, alpha
+    // blended ones too (all entity models are)
+    void renderDynamic(int i, const glm::mat4& matrix, SlotMap<Model>& scene) {
+        int res = settings.resolution;
+        glCopyImageSubData(staticMaps, GL_TEXTURE_2D_ARRAY, 0, 0, 0, i, maps, GL_TEXTURE_2D_ARRAY, 0, 0, 0, i, res, res, 1);
+        Frustum frustum = Frustum::fromMatrix(matrix);
+        beginLayer(maps, i, matrix);
+        for (Model& model : scene) {
+            if (!model.castsShadow) continue;
+            if (!frustum.visible(AABB(model.getAABBMin(), model.getAABBMax()))) continue;
+            for (const Mesh& mesh : model.meshes) drawMesh(mesh, model.modelMatrix);
+        }
+        endLayer();
+    }
+};
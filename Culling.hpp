@@ -0,0 +1,202 @@
+#pragma once
+#include <glm/glm.hpp>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
+
+#include "AABBTree.hpp"
+#include "Mesh.hpp"
+#include "Model.hpp"
+#include "SlotMap.hpp"
+#include "SoftwareOcclusion.hpp"
+
+// View frustum as six normalized planes (inside: dot(n, p) + d >= 0), stored
+// as structure of arrays in two groups of four so one box is tested against
+// four planes per SIMD instruction. The two padding planes accept everything.
+struct Frustum {
+    alignas(16) float nx[8], ny[8], nz[8], d[8];
+    alignas(16) float ax[8], ay[8], az[8];   // |n|, for the box extent along the normal
+
+    // planes of a projection * view matrix (Gribb / Hartmann), world space
+    static Frustum fromMatrix(const glm::mat4& m) {
+        glm::vec4 r0(m[0][0], m[1][0], m[2][0], m[3][0]);
+        glm::vec4 r1(m[0][1], m[1][1], m[2][1], m[3][1]);
+        glm::vec4 r2(m[0][2], m[1][2], m[2][2], m[3][2]);
+        glm::vec4 r3(m[0][3], m[1][3], m[2][3], m[3][3]);
+        glm::vec4 planes[6] = { r3 + r0, r3 - r0, r3 + r1, r3 - r1, r3 + r2, r3 - r2 };
+
+        Frustum f;
+        for (int i = 0; i < 8; ++i) {
+            glm::vec4 p(0.0f, 0.0f, 0.0f, 1.0f);
+            if (i < 6) p = planes[i] / glm::length(glm::vec3(planes[i]));
+            f.nx[i] = p.x; f.ny[i] = p.y; f.nz[i] = p.z; f.d[i] = p.w;
+            f.ax[i] = std::abs(p.x); f.ay[i] = std::abs(p.y); f.az[i] = std::abs(p.z);
+        }
+        return f;
+    }
+
+    // outside when the box is behind one plane, inside when it is in front of all
+    Containment classify(const AABB& box) const {
+        glm::vec3 c = (box.min + box.max) * 0.5f;
+        glm::vec3 e = (box.max - box.min) * 0.5f;
+#if defined(__SSE2__) || defined(_M_X64)
+        __m128 cx = _mm_set1_ps(c.x), cy = _mm_set1_ps(c.y), cz = _mm_set1_ps(c.z);
+        __m128 ex = _mm_set1_ps(e.x), ey = _mm_set1_ps(e.y), ez = _mm_set1_ps(e.z);
+        __m128 zero = _mm_setzero_ps();
+        int intersect = 0;
+        for (int g = 0; g < 8; g += 4) {
+            // signed distance of the center and projected radius of the box
+            __m128 dist = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_load_ps(nx + g), cx), _mm_mul_ps(_mm_load_ps(ny + g), cy)),
+                _mm_add_ps(_mm_mul_ps(_mm_load_ps(nz + g), cz), _mm_load_ps(d + g)));
+            __m128 radius = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_load_ps(ax + g), ex), _mm_mul_ps(_mm_load_ps(ay + g), ey)),
+                _mm_mul_ps(_mm_load_ps(az + g), ez));
+            if (_mm_movemask_ps(_mm_cmplt_ps(_mm_add_ps(dist, radius), zero))) return Containment::Outside;
+            intersect |= _mm_movemask_ps(_mm_cmplt_ps(_mm_sub_ps(dist, radius), zero));
+        }
+        return intersect ? Containment::Intersect : Containment::Inside;
+#else
+        bool intersect = false;
+        for (int i = 0; i < 6; ++i) {
+            float dist = nx[i] * c.x + ny[i] * c.y + nz[i] * c.z + d[i];
+            float radius = ax[i] * e.x + ay[i] * e.y + az[i] * e.z;
+            if (dist + radius < 0.0f) return Containment::Outside;
+            if (dist - radius < 0.0f) intersect = true;
+        }
+        return intersect ? Containment::Intersect : Containment::Inside;
+#endif
+    }
+
+    bool visible(const AABB& box) const { return classify(box) != Containment::Outside; }
+};
+
+// Visible set of the scene for one view. Models are kept in a dynamic AABB
+// tree refitted from their world boxes every frame (a move inside the fat
+// box costs one containment test), static meshes such as terrain tiles are
+// inserted once. cull() walks the tree with the frustum; subtrees fully
+// inside are taken without further plane tests. With a SoftwareOcclusion
+// buffer the boxes that pass the frustum are also tested against it.
+class SceneCuller {
+public:
+    struct Stats {
+        int visible = 0;
+        int culled = 0;     // frustum and occlusion
+        int occluded = 0;   // of culled
+    };
+
+    std::vector<Model*> visibleModels;
+    std::vector<Mesh*> visibleMeshes;   // static meshes
+    Stats stats;
+
+    SceneCuller() { tree.margin = 0.25f; }
+
+    // mesh that never moves, with its world bounds
+    void addStatic(Mesh& mesh, const AABB& bounds) {
+        tree.createProxy(bounds, staticMeshes.size(), StaticLayer);
+        staticMeshes.push_back(&mesh);
+    }
+
+    // every mesh of a model as its own static entry, bounds from the vertices
+    void addStatic(Model& model) {
+        model.updateAABBAndModelMatrix();
+        for (Mesh& mesh : model.meshes) {
+            AABB local;
+            for (const Vertex& v : mesh.vertices) {
+                local.min = glm::min(local.min, v.position);
+                local.max = glm::max(local.max, v.position);
+            }
+            addStatic(mesh, transform(local, model.modelMatrix));
+        }
+    }
+
+    // insert, refit and drop model proxies so the tree matches the scene
+    void sync(SlotMap<Model>& scene) {
+        ++frame;
+        for (std::size_t i = 0; i < scene.size(); ++i) {
+            Model& model = scene[i];
+            ModelHandle h = scene.handleAt(i);
+            if (h.index >= entries.size()) entries.resize(h.index + 1);
+            Entry& e = entries[h.index];
+            AABB bounds(model.getAABBMin(), model.getAABBMax());
+            if (e.proxy != DynamicAABBTree::NullNode && e.generation != h.generation) {
+                tree.destroyProxy(e.proxy);   // slot reused by another model
+                e.proxy = DynamicAABBTree::NullNode;
+            }
+            if (e.proxy == DynamicAABBTree::NullNode) {
+                e.proxy = tree.createProxy(bounds, h.toBits(), ModelLayer);
+                e.generation = h.generation;
+            }
+            else {
+                tree.moveProxy(e.proxy, bounds);
+            }
+            e.frame = frame;
+        }
+        // erased models
+        for (Entry& e : entries) {
+            if (e.proxy == DynamicAABBTree::NullNode || e.frame == frame) continue;
+            tree.destroyProxy(e.proxy);
+            e.proxy = DynamicAABBTree::NullNode;
+        }
+    }
+
+    // fill the visible lists for projection * view, occlusion is optional and
+    // must have been rendered for the same matrix
+    void cull(const glm::mat4& viewProjection, SlotMap<Model>& scene, const SoftwareOcclusion* occlusion = nullptr) {
+        frustum = Frustum::fromMatrix(viewProjection);
+        occluders = occlusion;
+        visibleModels.clear();
+        visibleMeshes.clear();
+        stats.occluded = 0;
+        tree.cull([&](const AABB& box) { return frustum.classify(box); },
+            [&](int proxy, bool inside) {
+                // leaves only intersecting with their fat box get a tight test
+                if (!inside && !frustum.visible(tree.getAABB(proxy))) return;
+                if (occluders && !occluders->visible(tree.getAABB(proxy))) {
+                    ++stats.occluded;
+                    return;
+                }
+                if (tree.getLayer(proxy) == StaticLayer) {
+                    visibleMeshes.push_back(staticMeshes[tree.getUserData(proxy)]);
+                }
+                else if (Model* m = scene.get(ModelHandle::fromBits(tree.getUserData(proxy)))) {
+                    visibleModels.push_back(m);
+                }
+            });
+        stats.visible = static_cast<int>(visibleModels.size() + visibleMeshes.size());
+        stats.culled = tree.getProxyCount() - stats.visible;
+    }
+
+    const Frustum& getFrustum() const { return frustum; }
+
+    // box around a box transformed by m
+    static AABB transform(const AABB& box, const glm::mat4& m) {
+        glm::vec3 c = glm::vec3(m * glm::vec4((box.min + box.max) * 0.5f, 1.0f));
+        glm::vec3 h = (box.max - box.min) * 0.5f;
+        glm::vec3 e = glm::abs(glm::vec3(m[0])) * h.x + glm::abs(glm::vec3(m[1])) * h.y + glm::abs(glm::vec3(m[2])) * h.z;
+        return AABB(c - e, c + e);
+    }
+
+    // same tests as cull() for a box outside the tree
+    bool visible(const AABB& box) const {
+        return frustum.visible(box) && (!occluders || occluders->visible(box));
+    }
+
+private:
+    static constexpr std::uint32_t ModelLayer = 1u << 0;
+    static constexpr std::uint32_t StaticLayer = 1u << 1;
+
+    struct Entry {
+        int proxy = DynamicAABBTree::NullNode;
+        std::uint32_t generation = 0;
+        std::uint64_t frame = 0;   // last sync that saw the model
+    };
+
+    DynamicAABBTree tree;
+    Frustum frustum = Frustum::fromMatrix(glm::mat4(1.0f));
+    const SoftwareOcclusion* occluders = nullptr;   // of the last cull()
+    std::vector<Entry> entries;          // by SlotMap slot
+    std::vector<Mesh*> staticMeshes;
+    std::uint64_t frame = 0;
+};
@@ -0,0 +1,150 @@
+#pragma once
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <algorithm>
+#include <cstddef>
+
+#include "ShaderProgram.hpp"
+
+// G-buffer of the deferred shading path: albedo (RGBA8), world normal
+// (RGBA16F) and depth (32F) at window size. Opaque geometry is written once
+// with gbuffer.frag, then every light shades only the pixels inside its
+// projected bounds (deferred_light.vert), so the lighting cost follows the
+// screen area of the lights instead of the rasterized fragments. The first
+// lighting pass copies the depth into the target framebuffer for the
+// forward passes drawn afterwards. Lights come from the LightBuffer bindings.
+class DeferredRenderer {
+public:
+    DeferredRenderer() = default;
+    DeferredRenderer(const DeferredRenderer&) = delete;
+    DeferredRenderer& operator=(const DeferredRenderer&) = delete;
+    ~DeferredRenderer() { clear(); }
+
+    void init() {
+        geometryProgram = ShaderProgram("resources/shaders/tex.vert", "resources/shaders/gbuffer.frag");
+        lightProgram = ShaderProgram("resources/shaders/deferred_light.vert", "resources/shaders/deferred_light.frag");
+        glCreateVertexArrays(1, &emptyVAO);
+    }
+
+    bool ready() const { return lightProgram.getID() != 0; }
+
+    // window size, the G-buffer is recreated on the next geometry pass
+    void setViewport(int w, int h) {
+        width = std::max(w, 1);
+        height = std::max(h, 1);
+    }
+
+    // replaces the mesh shaders while the G-buffer is bound
+    ShaderProgram& getGeometryProgram() { return geometryProgram; }
+    GLuint getFramebuffer() const { return framebuffer; }
+
+    // bind and clear the G-buffer, opaque geometry is drawn after this
+    void beginGeometry() {
+        if (!framebuffer || bufferWidth != width || bufferHeight != height) create();
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        const float zero[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+        const float far = 1.0f;
+        glClearNamedFramebufferfv(framebuffer, GL_COLOR, 0, zero);
+        glClearNamedFramebufferfv(framebuffer, GL_COLOR, 1, zero);
+        glClearNamedFramebufferfv(framebuffer, GL_DEPTH, 0, &far);
+    }
+
+    // back to the framebuffer the lighting is shaded into
+    void endGeometry(GLuint target) {
+        glBindFramebuffer(GL_FRAMEBUFFER, target);
+    }
+
+    // shade into the bound framebuffer: ambient and sun over the whole screen,
+    // then one screen rectangle per point and spot light, added up
+    void shade(const glm::mat4& projection, const glm::mat4& view, const glm::vec3& viewPos,
+        std::size_t pointLights, std::size_t spotLights) {
+        lightProgram.activate();
+        lightProgram.setUniform("uP_m", projection);
+        lightProgram.setUniform("uV_m", view);
+        lightProgram.setUniform("uInvViewProj", glm::inverse(projection * view));
+        lightProgram.setUniform("viewPos", viewPos);
+        lightProgram.setUniform("gAlbedo", 0);
+        lightProgram.setUniform("gNormal", 1);
+        lightProgram.setUniform("gDepth", 2);
+        glBindTextureUnit(0, albedo);
+        glBindTextureUnit(1, normal);
+        glBindTextureUnit(2, depth);
+        glBindVertexArray(emptyVAO);
+
+        // every covered pixel gets its G-buffer depth, the caller's depth test is restored after
+        GLint depthFunc = GL_LEQUAL;
+        glGetIntegerv(GL_DEPTH_FUNC, &depthFunc);
+        glDisable(GL_CULL_FACE);
+        glDepthFunc(GL_ALWAYS);
+        lightProgram.setUniform("lightType", 0);
+        glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+
+        glDisable(GL_DEPTH_TEST);
+        glEnable(GL_BLEND);
+        glBlendFunc(GL_ONE, GL_ONE);
+        if (pointLights > 0) {
+            lightProgram.setUniform("lightType", 1);
+            glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, static_cast<GLsizei>(pointLights));
+        }
+        if (spotLights > 0) {
+            lightProgram.setUniform("lightType", 2);
+            glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, static_cast<GLsizei>(spotLights));
+        }
+
+        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+        glDisable(GL_BLEND);
+        glEnable(GL_DEPTH_TEST);
+        glDepthFunc(depthFunc);
+        glEnable(GL_CULL_FACE);
+        glBindVertexArray(0);
+        lightProgram.deactivate();
+    }
+
+    void clear() {
+        destroyBuffers();
+        geometryProgram.clear();
+        lightProgram.clear();
+        if (emptyVAO) glDeleteVertexArrays(1, &emptyVAO);
+        emptyVAO = 0;
+    }
+
+private:
+    ShaderProgram geometryProgram, lightProgram;
+    GLuint framebuffer = 0, albedo = 0, normal = 0, depth = 0;
+    GLuint emptyVAO = 0;   // the lighting passes have no vertex attributes
+    int width = 1, height = 1;
+    int bufferWidth = 0, bufferHeight = 0;
+
+    void create() {
+        destroyBuffers();
+        glCreateTextures(GL_TEXTURE_2D, 1, &albedo);
+        glTextureStorage2D(albedo, 1, GL_RGBA8, width, height);
+        glCreateTextures(GL_TEXTURE_2D, 1, &normal);
+        glTextureStorage2D(normal, 1, GL_RGBA16F, width, height);
+        glCreateTextures(GL_TEXTURE_2D, 1, &depth);
+        glTextureStorage2D(depth, 1, GL_DEPTH_COMPONENT32F, width, height);
+        for (GLuint t : { albedo, normal, depth }) {
+            glTextureParameteri(t, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+            glTextureParameteri(t, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        }
+
+        glCreateFramebuffers(1, &framebuffer);
+        glNamedFramebufferTexture(framebuffer, GL_COLOR_ATTACHMENT0, albedo, 0);
+        glNamedFramebufferTexture(framebuffer, GL_COLOR_ATTACHMENT1, normal, 0);
+        glNamedFramebufferTexture(framebuffer, GL_DEPTH_ATTACHMENT, depth, 0);
+        const GLenum attachments[2] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
+        glNamedFramebufferDrawBuffers(framebuffer, 2, attachments);
+        bufferWidth = width;
+        bufferHeight = height;
+    }
+
+    void destroyBuffers() {
+        if (framebuffer) glDeleteFramebuffers(1, &framebuffer);
+        for (GLuint* t : { &albedo, &normal, &depth }) {
+            if (*t) glDeleteTextures(1, t);
+            *t = 0;
+        }
+        framebuffer = 0;
+        bufferWidth = bufferHeight = 0;
+    }
+};
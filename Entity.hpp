@@ -3,7 +3,9 @@
 #include <functional>
 #include <vector>
 #include "Model.hpp"
-#include "Camera.hpp"
+#include "camera.hpp"
+#include "AABBTree.hpp"
+#include "TransformSystem.hpp"
 
 
 class Entity {
@@ -13,6 +15,10 @@ public:
     glm::vec3 acceleration;
     glm::vec3 rotation = glm::vec3(0.0f);
 
+    // state of the previous simulation tick, used for render interpolation
+    glm::vec3 previousPosition;
+    glm::vec3 previousRotation = glm::vec3(0.0f);
+
     float yaw = -90.0f, pitch = 0.0f;
     float movementSpeed = 10.0f;
     float drag = 1.0f;
@@ -20,16 +26,62 @@ public:
     bool isGrounded = true;
 
     Camera* camera;
-    Model* model; // optional visual
+    Model* model; // optional visual, resolved from modelHandle by the owner of the model storage
+    ModelHandle modelHandle;
+    // when set, the transform system places the model instead of the entity
+    TransformSystem::Node transformNode = TransformSystem::Null;
+
+    // broadphase registration
+    int broadphaseProxy = DynamicAABBTree::NullNode;
+    std::uint32_t collisionLayer = CollisionLayer::Bot;
+
+    // simulation LOD: the phase spreads reduced rate updates over ticks,
+    // lastSimTick/simInterval give the elapsed time and interpolation span
+    std::uint32_t simPhase = 0;
+    std::uint64_t lastSimTick = 0;
+    int simInterval = 1;
 
     using Behavior = std::function<void(Entity&, float)>;
     std::vector<Behavior> behaviors;
 
     Entity(glm::vec3 pos, Model* mdl = nullptr, Camera* camera = nullptr)
-        : position(pos), velocity(0.0f), acceleration(0.0f), model(mdl), camera(camera){
+        : position(pos), previousPosition(pos), velocity(0.0f), acceleration(0.0f), model(mdl), camera(camera){
+    }
+
+    Entity() : position(0.0f), previousPosition(0.0f), model(nullptr), velocity(0.0f), acceleration(0.0f), camera(nullptr) {}
+
+    // call once before every fixed simulation tick
+    void storePreviousState() {
+        previousPosition = position;
+        previousRotation = rotation;
+    }
+
+    // world matrix of the simulated state; the model holds the interpolated
+    // render pose, which lags behind for entities not due this tick
+    glm::mat4 simulatedMatrix() const {
+        return TransformSystem::composeLocal(position, rotation, model ? model->scale : glm::vec3(1.0f));
+    }
+
+    // collision shapes of the simulated state, need a model
+    OBB getOBB() const {
+        return Narrowphase::makeOBB(simulatedMatrix(), model->localCenter, model->localHalfExtents);
     }
 
-    Entity() : position(0.0f), model(nullptr), velocity(0.0f), acceleration(0.0f), camera(nullptr) {}
+    AABB getBounds() const {
+        glm::mat4 m = simulatedMatrix();
+        glm::vec3 center = glm::vec3(m * glm::vec4(model->localCenter, 1.0f));
+        glm::vec3 extent = glm::abs(glm::vec3(m[0])) * model->localHalfExtents.x
+            + glm::abs(glm::vec3(m[1])) * model->localHalfExtents.y
+            + glm::abs(glm::vec3(m[2])) * model->localHalfExtents.z;
+        return AABB(center - extent, center + extent);
+    }
+
+    // place the model between the last two ticks, alpha in [0, 1)
+    void interpolateModel(float alpha) {
+        if (!model || transformNode != TransformSystem::Null) return;
+        model->setPos(glm::mix(previousPosition, position, alpha));
+        model->setRotation(glm::mix(previousRotation, rotation, alpha));
+    }
 
 
     void update(float dt, float groundHeight) {
@@ -53,7 +105,7 @@ public:
             isGrounded = false;
         }
         acceleration = glm::vec3(0.0f);
-        if (model) {
+        if (model && transformNode == TransformSystem::Null) {
             model->setPos(position);
             model->setRotation(rotation); 
         }
@@ -67,13 +119,31 @@ public:
 
     void setSpeed(glm::vec3 speed) { velocity = speed; }
 
+    void applyImpulse(const glm::vec3& impulse) { velocity += impulse; }
+
+    // push out of a contact along normal (pointing away from the other body)
+    // and reflect the approaching part of the velocity
+    void resolveContact(const glm::vec3& normal, float depth, float restitution = 0.5f) {
+        position += normal * depth;
+        float approach = glm::dot(velocity, normal);
+        if (approach < 0.0f) velocity -= (1.0f + restitution) * approach * normal;
+    }
+
+    // write the current (or interpolated) state into the entity's transform node,
+    // unchanged values leave the node clean
+    void syncTransform(TransformSystem& transforms, float alpha = 1.0f) {
+        if (transformNode == TransformSystem::Null) return;
+        transforms.setPosition(transformNode, glm::mix(previousPosition, position, alpha));
+        transforms.setRotation(transformNode, glm::mix(previousRotation, rotation, alpha));
+    }
+
     void setGravity(const float gravity) {
         this->gravity = gravity;
     }
 
     void updatePos(const float x = 0, const float y = 0, const float z = 0) {
         position += glm::vec3(x, y, z);
-        if (model) model->setPos(position);
+        if (model && transformNode == TransformSystem::Null) model->setPos(position);
     }
 
     void jump(float strength) {
@@ -0,0 +1,51 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+// Accumulator based fixed-step clock.
+// Rendering feeds in the raw frame time, the simulation consumes it in
+// constant ticks. The leftover fraction is used to interpolate transforms.
+class FixedTimestep {
+public:
+    double step = 1.0 / 60.0;        // seconds per simulation tick
+    int maxStepsPerFrame = 5;        // cap to avoid the "spiral of death"
+    double maxFrameTime = 0.25;      // longer frames (breakpoints, window drag) are clamped
+    std::uint64_t tick = 0;          // total ticks simulated so far
+
+    FixedTimestep() = default;
+    FixedTimestep(double tickRate, int maxSteps) { setTickRate(tickRate); maxStepsPerFrame = std::max(1, maxSteps); }
+
+    void setTickRate(double tickRate) {
+        step = 1.0 / std::max(1.0, tickRate);
+    }
+
+    double tickRate() const { return 1.0 / step; }
+
+    // add elapsed frame time, returns number of ticks to simulate this frame
+    int advance(double frameTime) {
+        accumulator += std::clamp(frameTime, 0.0, maxFrameTime);
+
+        int steps = static_cast<int>(accumulator / step);
+        if (steps > maxStepsPerFrame) {
+            // too far behind: drop the backlog instead of trying to catch up
+            steps = maxStepsPerFrame;
+            accumulator = std::fmod(accumulator, step);
+        }
+        else {
+            accumulator -= steps * step;
+        }
+        tick += steps;
+        return steps;
+    }
+
+    // interpolation factor between the previous and the current tick, [0, 1)
+    float alpha() const {
+        return static_cast<float>(accumulator / step);
+    }
+
+    void reset() { accumulator = 0.0; tick = 0; }
+
+private:
+    double accumulator = 0.0;
+};
@@ -0,0 +1,283 @@
+#pragma once
+#include <glm/glm.hpp>
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <queue>
+#include <utility>
+#include <vector>
+
+#include "Model.hpp"
+#include "JobSystem.hpp"
+
+// Walkability grid sampled from the terrain heightmap. The cost of a cell
+// grows with its slope, cells steeper than maxSlope are blocked.
+class NavGrid {
+public:
+    static constexpr float Blocked = FLT_MAX;
+
+    NavGrid() = default;
+
+    NavGrid(Terrain& terrain, float cellSize = 0.25f, float maxSlope = 1.5f, float slopeCost = 4.0f)
+        : cellSize(cellSize) {
+        glm::vec3 lo = terrain.getAABBMin();
+        glm::vec3 hi = terrain.getAABBMax();
+        origin = glm::vec2(lo.x, lo.z);
+        width = std::max(1, static_cast<int>((hi.x - lo.x) / cellSize));
+        height = std::max(1, static_cast<int>((hi.z - lo.z) / cellSize));
+
+        std::vector<float> h(static_cast<std::size_t>(width) * height);
+        for (int z = 0; z < height; ++z) {
+            for (int x = 0; x < width; ++x) {
+                glm::vec2 p = cellCenter(x, z);
+                h[index(x, z)] = terrain.getHeightAt(p.x, p.y);
+            }
+        }
+
+        // slope from central differences
+        cost.resize(h.size());
+        for (int z = 0; z < height; ++z) {
+            for (int x = 0; x < width; ++x) {
+                int x0 = std::max(x - 1, 0), x1 = std::min(x + 1, width - 1);
+                int z0 = std::max(z - 1, 0), z1 = std::min(z + 1, height - 1);
+                float dx = (h[index(x1, z)] - h[index(x0, z)]) / (std::max(1, x1 - x0) * cellSize);
+                float dz = (h[index(x, z1)] - h[index(x, z0)]) / (std::max(1, z1 - z0) * cellSize);
+                float slope = std::sqrt(dx * dx + dz * dz);
+                cost[index(x, z)] = slope > maxSlope ? Blocked : 1.0f + slopeCost * slope;
+            }
+        }
+    }
+
+    int getWidth() const { return width; }
+    int getHeight() const { return height; }
+    float getCellSize() const { return cellSize; }
+    std::size_t cellCount() const { return cost.size(); }
+
+    bool inside(int x, int z) const { return x >= 0 && z >= 0 && x < width && z < height; }
+    std::size_t index(int x, int z) const { return static_cast<std::size_t>(z) * width + x; }
+    float getCost(int x, int z) const { return cost[index(x, z)]; }
+
+    // cell of a world position, clamped to the grid
+    glm::ivec2 cellOf(const glm::vec3& p) const {
+        int x = static_cast<int>(std::floor((p.x - origin.x) / cellSize));
+        int z = static_cast<int>(std::floor((p.z - origin.y) / cellSize));
+        return glm::ivec2(std::clamp(x, 0, width - 1), std::clamp(z, 0, height - 1));
+    }
+
+    glm::vec2 cellCenter(int x, int z) const {
+        return origin + (glm::vec2(x, z) + 0.5f) * cellSize;
+    }
+
+private:
+    glm::vec2 origin{ 0.0f };
+    float cellSize = 1.0f;
+    int width = 0, height = 0;
+    std::vector<float> cost;
+};
+
+// Integration field (cost to the nearest goal) and the derived flow field
+// (direction to the cheapest neighbour) for one set of goals, shared by every
+// agent heading there. The field is built in slices: integrate() settles a
+// bounded number of cells of the multi-source Dijkstra and then derives the
+// directions row by row, so a build is spread over several ticks instead of
+// one long job. A goal that moves starts a new build, since every cell of
+// the old shortest path tree holds its distance to the old goal.
+class FlowField {
+public:
+    FlowField() = default;
+
+    // seeds the goal cells, nothing is integrated yet
+    FlowField(std::shared_ptr<const NavGrid> navGrid, const std::vector<glm::vec3>& goals) : grid(std::move(navGrid)) {
+        const NavGrid& g = *grid;
+        integration.assign(g.cellCount(), FLT_MAX);
+        direction.assign(g.cellCount(), glm::vec2(0.0f));
+        for (const auto& goal : goals) {
+            glm::ivec2 c = g.cellOf(goal);
+            std::size_t i = g.index(c.x, c.y);
+            integration[i] = 0.0f;
+            open.push({ 0.0f, static_cast<std::uint32_t>(i) });
+        }
+    }
+
+    // advance the build by about maxCells cells, true once it is complete
+    bool integrate(std::size_t maxCells = SIZE_MAX) {
+        if (!grid) return true;
+        const NavGrid& g = *grid;
+        std::size_t budget = std::max<std::size_t>(maxCells, 1);
+
+        // Dijkstra from all goal cells at once, 8-connected
+        while (!open.empty() && budget > 0) {
+            auto [dist, i] = open.top();
+            open.pop();
+            --budget;
+            if (dist > integration[i]) continue; // stale entry
+            int x = static_cast<int>(i % g.getWidth()), z = static_cast<int>(i / g.getWidth());
+            for (int n = 0; n < 8; ++n) {
+                int nx = x + NX[n], nz = z + NZ[n];
+                if (!g.inside(nx, nz) || !walkable(x, z, n)) continue;
+                float c = g.getCost(nx, nz);
+                float next = dist + c * (n < 4 ? 1.0f : 1.41421356f);
+                std::size_t j = g.index(nx, nz);
+                if (next < integration[j]) {
+                    integration[j] = next;
+                    open.push({ next, static_cast<std::uint32_t>(j) });
+                }
+            }
+        }
+        if (!open.empty()) return false;
+        if (flowRows == 0) open = {};   // release the queue storage
+
+        // flow: unit direction to the neighbour with the lowest integration value
+        for (; flowRows < g.getHeight() && budget > 0; ++flowRows) {
+            int z = flowRows;
+            for (int x = 0; x < g.getWidth(); ++x) {
+                std::size_t i = g.index(x, z);
+                float best = integration[i];
+                int bestN = -1;
+                for (int n = 0; n < 8; ++n) {
+                    int nx = x + NX[n], nz = z + NZ[n];
+                    if (!g.inside(nx, nz) || !walkable(x, z, n)) continue;
+                    float v = integration[g.index(nx, nz)];
+                    if (v < best) { best = v; bestN = n; }
+                }
+                if (bestN >= 0) direction[i] = glm::normalize(glm::vec2(NX[bestN], NZ[bestN]));
+            }
+            budget -= std::min<std::size_t>(budget, static_cast<std::size_t>(g.getWidth()));
+        }
+        return complete();
+    }
+
+    bool complete() const { return !grid || (open.empty() && flowRows == grid->getHeight()); }
+
+    bool empty() const { return !grid; }
+
+    // O(1): unit XZ direction to follow at a world position, zero at a goal
+    // or where no goal is reachable
+    glm::vec3 sample(const glm::vec3& p) const {
+        if (!grid) return glm::vec3(0.0f);
+        glm::ivec2 c = grid->cellOf(p);
+        glm::vec2 d = direction[grid->index(c.x, c.y)];
+        return glm::vec3(d.x, 0.0f, d.y);
+    }
+
+    // weighted path cost to the nearest goal, FLT_MAX if unreachable
+    float cost(const glm::vec3& p) const {
+        if (!grid) return FLT_MAX;
+        glm::ivec2 c = grid->cellOf(p);
+        return integration[grid->index(c.x, c.y)];
+    }
+
+private:
+    // orthogonal first, then diagonal
+    static constexpr int NX[8] = { 1, -1, 0, 0, 1, -1, 1, -1 };
+    static constexpr int NZ[8] = { 0, 0, 1, -1, 1, 1, -1, -1 };
+
+    using Entry = std::pair<float, std::uint32_t>;
+
+    std::shared_ptr<const NavGrid> grid;
+    std::vector<float> integration;
+    std::vector<glm::vec2> direction;
+    std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry>> open;   // of the build in progress
+    int flowRows = 0;   // rows with directions derived
+
+    // target cell is not blocked, diagonals must not cut a blocked corner
+    bool walkable(int x, int z, int n) const {
+        const NavGrid& g = *grid;
+        int nx = x + NX[n], nz = z + NZ[n];
+        if (g.getCost(nx, nz) == NavGrid::Blocked) return false;
+        if (n < 4) return true;
+        return g.getCost(nx, z) != NavGrid::Blocked && g.getCost(x, nz) != NavGrid::Blocked;
+    }
+};
+
+// Keeps the current flow field and builds the next one on the job system
+// when the goals move to another cell, one slice of sliceCells per update().
+// Agents keep sampling the previous field until the new one is complete. At
+// most one build is in flight and goal changes meanwhile collapse into the
+// latest one, so the work per tick is bounded by the slice, never by the
+// grid size or the agent count.
+class FlowFieldPlanner {
+public:
+    FlowFieldPlanner() = default;
+
+    // without a job system the slices run synchronously in update()
+    void setJobSystem(JobSystem* jobSystem) { jobs = jobSystem; }
+
+    // cells settled (or flow cells derived) per slice
+    void setSliceBudget(std::size_t cells) { sliceCells = std::max<std::size_t>(cells, 1); }
+
+    // lockstep: update() waits for the slice started by the previous one, so
+    // the tick a field is published depends only on the grid and the budget,
+    // not on thread timing; otherwise a slice still running skips the tick
+    void setLockstep(bool on) { lockstep = on; }
+
+    void setGrid(std::shared_ptr<const NavGrid> navGrid) {
+        // a slice still in flight works on its own captured field, dropped here
+        pending = {};
+        building = {};
+        grid = std::move(navGrid);
+        current = std::make_shared<const FlowField>();
+        requestedCells.clear();
+    }
+
+    // new goal set, ignored while the goals stay in the same cells
+    void setGoals(const std::vector<glm::vec3>& goals) {
+        if (!grid) return;
+        std::vector<glm::ivec2> cells;
+        cells.reserve(goals.size());
+        for (const auto& goal : goals) cells.push_back(grid->cellOf(goal));
+        if (cells == requestedCells) return;
+        requestedCells = std::move(cells);
+        queuedGoals = goals;
+        dirty = true;
+    }
+
+    // call once per tick: publishes a complete field and runs the next slice
+    void update() {
+        if (pending) {
+            if (lockstep) jobs->wait(pending);
+            else if (!pending->done()) return;
+            pending = {};
+        }
+        publish();
+        if (!building) {
+            if (!dirty) return;
+            dirty = false;
+            building = std::make_shared<FlowField>(grid, queuedGoals);
+        }
+        if (!jobs) {
+            building->integrate(sliceCells);
+            publish();
+            return;
+        }
+        // the job only touches its captures, the planner may go away meanwhile
+        pending = jobs->run([field = building, cells = sliceCells] { field->integrate(cells); });
+    }
+
+    // snapshot, stays valid while a newer field is published
+    std::shared_ptr<const FlowField> getField() const { return current; }
+
+    glm::vec3 sample(const glm::vec3& p) const { return current->sample(p); }
+    float cost(const glm::vec3& p) const { return current->cost(p); }
+    bool ready() const { return !current->empty(); }
+
+private:
+    JobSystem* jobs = nullptr;
+    std::shared_ptr<const NavGrid> grid;
+    std::shared_ptr<const FlowField> current = std::make_shared<const FlowField>();
+    std::shared_ptr<FlowField> building;   // next field, touched by one slice job at a time
+    JobSystem::Handle pending;
+    std::vector<glm::ivec2> requestedCells;
+    std::vector<glm::vec3> queuedGoals;
+    bool dirty = false;
+    bool lockstep = false;
+    std::size_t sliceCells = 16384;
+
+    void publish() {
+        if (!building || !building->complete()) return;
+        current = std::move(building);
+        building = {};
+    }
+};
@@ -0,0 +1,374 @@
+#pragma once
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <numeric>
+#include <vector>
+
+#include "ShaderProgram.hpp"
+#include "Model.hpp"
+
+// Particle simulation running entirely on the GPU.
+// Particles live in a fixed SSBO pool. Free slots are kept on a dead list,
+// live ones on two alive lists that swap every frame: the update pass reads
+// one list and appends survivors to the other. Counters on the GPU feed the
+// dispatch size of the update pass and the instance count of the draw through
+// indirect arguments, so the CPU never waits for how many particles exist;
+// a fenced copy of the count, read a few frames late when ready, only bounds
+// the number of sort passes (count then + emitted since).
+// The CPU only uploads emit requests (origin + count), not particles.
+// Drawing sorts the alive particles far to near with a bitonic sort on the
+// GPU and renders them as instanced camera facing quads, faded where they
+// meet the scene depth (soft particles).
+class GPUParticleSystem {
+public:
+    glm::vec3 gravity{ 0.0f, -9.81f, 0.0f };
+    float restitution = 0.4f;    // vertical speed kept after a terrain bounce
+    float friction = 0.8f;       // horizontal speed kept after a terrain bounce
+    float size = 0.05f;          // sprite radius at full life
+    float softness = 0.2f;       // distance over which sprites fade into geometry
+    glm::vec4 color{ 1.0f, 0.5f, 0.0f, 1.0f };
+
+    GPUParticleSystem() = default;
+    GPUParticleSystem(const GPUParticleSystem&) = delete;
+    GPUParticleSystem& operator=(const GPUParticleSystem&) = delete;
+    ~GPUParticleSystem() { clear(); }
+
+    // needs a GL context; the terrain is sampled once into a height texture
+    void init(std::uint32_t particleCapacity, Terrain* terrain, int heightResolution = 512) {
+        clear();
+        capacity = std::max<std::uint32_t>(1, particleCapacity);
+
+        emitProgram = ShaderProgram("resources/shaders/gpu_particles_emit.comp");
+        prepareProgram = ShaderProgram("resources/shaders/gpu_particles_prepare.comp");
+        updateProgram = ShaderProgram("resources/shaders/gpu_particles_update.comp");
+        finishProgram = ShaderProgram("resources/shaders/gpu_particles_finish.comp");
+        sortKeysProgram = ShaderProgram("resources/shaders/gpu_particles_sort_keys.comp");
+        sortProgram = ShaderProgram("resources/shaders/gpu_particles_sort.comp");
+        drawProgram = ShaderProgram("resources/shaders/gpu_particle.vert", "resources/shaders/gpu_particle.frag");
+
+        glCreateBuffers(1, &particleBuffer);
+        glNamedBufferStorage(particleBuffer, GLsizeiptr(capacity) * sizeof(GPUParticle), nullptr, 0);
+
+        glCreateBuffers(1, &aliveBuffer);
+        glNamedBufferStorage(aliveBuffer, GLsizeiptr(capacity) * 2 * sizeof(std::uint32_t), nullptr, 0);
+
+        // every slot starts free
+        std::vector<std::uint32_t> free(capacity);
+        std::iota(free.begin(), free.end(), 0u);
+        glCreateBuffers(1, &deadBuffer);
+        glNamedBufferStorage(deadBuffer, GLsizeiptr(capacity) * sizeof(std::uint32_t), free.data(), 0);
+
+        Counters counters{};
+        counters.dead = capacity;
+        counters.dispatch[1] = counters.dispatch[2] = 1;
+        counters.keyArgs[0] = 2;
+        counters.keyArgs[1] = counters.keyArgs[2] = 1;
+        counters.sortArgs[0] = counters.sortArgs[1] = counters.sortArgs[2] = 1;
+        counters.sortArgs[3] = 512;
+        glCreateBuffers(1, &counterBuffer);
+        glNamedBufferStorage(counterBuffer, sizeof(Counters), &counters, 0);
+        glCreateBuffers(1, &readbackBuffer);
+        glNamedBufferStorage(readbackBuffer, sizeof(std::uint32_t), nullptr, GL_CLIENT_STORAGE_BIT);
+        liveBound = emittedSinceReadback = 0;
+
+        // bitonic sort works on powers of two, in blocks of 512
+        sortCapacity = 512;
+        while (sortCapacity < capacity) sortCapacity <<= 1;
+        glCreateBuffers(1, &sortBuffer);
+        glNamedBufferStorage(sortBuffer, GLsizeiptr(sortCapacity) * 2 * sizeof(std::uint32_t), nullptr, 0);
+
+        emitCapacity = 0;
+        reserveEmitBuffer(256);
+
+        initHeightField(terrain, std::max(2, heightResolution));
+    }
+
+    void clear() {
+        if (particleBuffer) glDeleteBuffers(1, &particleBuffer);
+        if (aliveBuffer) glDeleteBuffers(1, &aliveBuffer);
+        if (deadBuffer) glDeleteBuffers(1, &deadBuffer);
+        if (counterBuffer) glDeleteBuffers(1, &counterBuffer);
+        if (emitBuffer) glDeleteBuffers(1, &emitBuffer);
+        if (sortBuffer) glDeleteBuffers(1, &sortBuffer);
+        if (readbackBuffer) glDeleteBuffers(1, &readbackBuffer);
+        if (readbackFence) glDeleteSync(readbackFence);
+        readbackBuffer = 0;
+        readbackFence = nullptr;
+        if (heightField) glDeleteTextures(1, &heightField);
+        if (emptyVAO) glDeleteVertexArrays(1, &emptyVAO);
+        if (depthCopy) glDeleteTextures(1, &depthCopy);
+        if (depthFBO) glDeleteFramebuffers(1, &depthFBO);
+        particleBuffer = aliveBuffer = deadBuffer = counterBuffer = emitBuffer = sortBuffer = 0;
+        heightField = emptyVAO = depthCopy = depthFBO = 0;
+        depthWidth = depthHeight = 0;
+        emitProgram.clear();
+        prepareProgram.clear();
+        updateProgram.clear();
+        finishProgram.clear();
+        sortKeysProgram.clear();
+        sortProgram.clear();
+        drawProgram.clear();
+        requests.clear();
+        pendingCount = 0;
+        capacity = 0;
+    }
+
+    bool ready() const { return particleBuffer != 0; }
+    std::uint32_t getCapacity() const { return capacity; }
+
+    // queued until the next update(); requests over the free pool are dropped on the GPU
+    void emit(const glm::vec3& origin, int count, float speed = 2.0f, float life = 0.5f, float lifeJitter = 1.0f) {
+        if (count <= 0 || !ready()) return;
+        // nothing past the pool size can be spawned in one frame anyway
+        std::uint32_t n = std::min<std::uint32_t>(static_cast<std::uint32_t>(count), capacity - std::min(capacity, pendingCount));
+        if (n == 0) return;
+        EmitRequest r;
+        r.origin = glm::vec4(origin, 0.0f);
+        r.params = glm::vec4(speed, life, lifeJitter, 0.0f);
+        r.range = glm::uvec4(pendingCount, n, 0u, 0u);
+        requests.push_back(r);
+        pendingCount += n;
+    }
+
+    // emit, simulate and prepare the draw for this frame
+    void update(float dt) {
+        if (!ready()) return;
+
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, particleBuffer);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, aliveBuffer);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, deadBuffer);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, counterBuffer);
+
+        if (!requests.empty()) {
+            reserveEmitBuffer(requests.size());
+            glNamedBufferSubData(emitBuffer, 0, GLsizeiptr(requests.size() * sizeof(EmitRequest)), requests.data());
+            glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, emitBuffer);
+
+            emitProgram.activate();
+            emitProgram.setUniform("requestCount", static_cast<int>(requests.size()));
+            emitProgram.setUniform("totalCount", static_cast<int>(pendingCount));
+            emitProgram.setUniform("current", current);
+            emitProgram.setUniform("capacity", static_cast<int>(capacity));
+            glProgramUniform1ui(emitProgram.getID(), emitProgram.getUniformLocation("seed"), ++seed * 0x9E3779B9u);
+            glDispatchCompute((pendingCount + 63) / 64, 1, 1);
+            glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+            liveBound = std::min(capacity, liveBound + pendingCount);
+            emittedSinceReadback += pendingCount;
+            requests.clear();
+            pendingCount = 0;
+        }
+
+        // dispatch size from the alive count, without a CPU read back
+        prepareProgram.activate();
+        prepareProgram.setUniform("current", current);
+        glDispatchCompute(1, 1, 1);
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_COMMAND_BARRIER_BIT);
+
+        updateProgram.activate();
+        updateProgram.setUniform("current", current);
+        updateProgram.setUniform("capacity", static_cast<int>(capacity));
+        updateProgram.setUniform("dt", dt);
+        updateProgram.setUniform("gravity", gravity);
+        updateProgram.setUniform("restitution", restitution);
+        updateProgram.setUniform("friction", friction);
+        updateProgram.setUniform("heightBounds", heightBounds);
+        updateProgram.setUniform("heightField", 0);
+        glBindTextureUnit(0, heightField);
+        glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, counterBuffer);
+        glDispatchComputeIndirect(offsetof(Counters, dispatch));
+        glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, 0);
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+        current = 1 - current;
+
+        finishProgram.activate();
+        finishProgram.setUniform("current", current);
+        glDispatchCompute(1, 1, 1);
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_COMMAND_BARRIER_BIT);
+        finishProgram.deactivate();
+        readBackCount();
+    }
+
+    // sorted soft sprites over the opaque scene in sceneFramebuffer (width x
+    // height, 32F depth); call after opaque geometry, with blending enabled
+    void draw(const glm::mat4& projection, const glm::mat4& view, GLuint sceneFramebuffer, int width, int height) {
+        if (!ready() || liveBound == 0 || width <= 0 || height <= 0) return;
+        if (!emptyVAO) glCreateVertexArrays(1, &emptyVAO);
+
+        glm::vec3 eye = glm::vec3(glm::inverse(view)[3]);
+        sort(eye);
+        copySceneDepth(sceneFramebuffer, width, height);
+
+        drawProgram.activate();
+        drawProgram.setUniform("projection", projection);
+        drawProgram.setUniform("view", view);
+        drawProgram.setUniform("size", size);
+        drawProgram.setUniform("softness", softness);
+        drawProgram.setUniform("color", color);
+        drawProgram.setUniform("sceneDepth", 0);
+        glBindTextureUnit(0, depthCopy);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, particleBuffer);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 5, sortBuffer);
+
+        // four vertices per instance, instance count written by the finish pass
+        glBindVertexArray(emptyVAO);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, counterBuffer);
+        glDrawArraysIndirect(GL_TRIANGLE_STRIP, reinterpret_cast<const void*>(offsetof(Counters, draw)));
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+        glBindVertexArray(0);
+    }
+
+private:
+    // std430 layouts, must match the shaders
+    struct GPUParticle {
+        glm::vec4 position;   // xyz, w = remaining life
+        glm::vec4 velocity;   // xyz, w = total life
+    };
+    struct EmitRequest {
+        glm::vec4 origin;
+        glm::vec4 params;     // speed, life, life jitter
+        glm::uvec4 range;     // first invocation, count
+    };
+    struct Counters {
+        std::uint32_t alive[2];
+        std::uint32_t dead;
+        std::uint32_t pad;
+        std::uint32_t dispatch[4];   // DispatchIndirectCommand
+        std::uint32_t draw[4];       // DrawArraysIndirectCommand
+        std::uint32_t keyArgs[4];    // DispatchIndirectCommand of the key pass
+        std::uint32_t sortArgs[4];   // DispatchIndirectCommand of a sort pass, padded size
+    };
+    static_assert(sizeof(GPUParticle) == 32 && sizeof(EmitRequest) == 48 && sizeof(Counters) == 80);
+
+    ShaderProgram emitProgram, prepareProgram, updateProgram, finishProgram;
+    ShaderProgram sortKeysProgram, sortProgram, drawProgram;
+    GLuint particleBuffer = 0, aliveBuffer = 0, deadBuffer = 0, counterBuffer = 0, emitBuffer = 0, sortBuffer = 0;
+    GLuint heightField = 0, emptyVAO = 0;
+    GLuint depthCopy = 0, depthFBO = 0;
+    GLuint readbackBuffer = 0;        // alive count copied after a finish pass
+    GLsync readbackFence = nullptr;   // of the copy in flight
+    std::uint32_t liveBound = 0;      // upper bound of the alive count
+    std::uint32_t emittedSinceReadback = 0;
+    int depthWidth = 0, depthHeight = 0;
+    std::uint32_t sortCapacity = 0;
+    glm::vec4 heightBounds{ 0.0f };   // min x, min z, 1 / size x, 1 / size z
+    std::uint32_t capacity = 0;
+    std::size_t emitCapacity = 0;
+    std::vector<EmitRequest> requests;
+    std::uint32_t pendingCount = 0;
+    std::uint32_t seed = 0;
+    int current = 0;                  // alive list read by the next update
+
+    // far to near order of the alive particles. The passes run up to the
+    // power of two above liveBound, passes above the actual padded count exit
+    // right away and all dispatch sizes come from the counters.
+    void sort(const glm::vec3& eye) {
+        std::uint32_t sortLimit = 512;
+        while (sortLimit < liveBound) sortLimit <<= 1;
+
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, particleBuffer);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, aliveBuffer);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, counterBuffer);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 5, sortBuffer);
+        glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, counterBuffer);
+
+        sortKeysProgram.activate();
+        sortKeysProgram.setUniform("current", current);
+        sortKeysProgram.setUniform("capacity", static_cast<int>(capacity));
+        sortKeysProgram.setUniform("eye", eye);
+        glDispatchComputeIndirect(offsetof(Counters, keyArgs));
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+        sortProgram.activate();
+        GLuint id = sortProgram.getID();
+        GLint kLoc = sortProgram.getUniformLocation("k"), jLoc = sortProgram.getUniformLocation("j");
+        auto pass = [&](int mode, std::uint32_t k, std::uint32_t j) {
+            sortProgram.setUniform("mode", mode);
+            glProgramUniform1ui(id, kLoc, k);
+            glProgramUniform1ui(id, jLoc, j);
+            glDispatchComputeIndirect(offsetof(Counters, sortArgs));
+            glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+        };
+        pass(0, 512, 0);
+        for (std::uint32_t k = 1024; k <= std::min(sortLimit, sortCapacity); k <<= 1) {
+            for (std::uint32_t j = k / 2; j >= 512; j >>= 1) pass(2, k, j);
+            pass(1, k, 0);
+        }
+        glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, 0);
+        sortProgram.deactivate();
+    }
+
+    // the scene depth is multisampled with MSAA, blit (and resolve) it into a
+    // texture of the same format, a mismatched depth blit is an error
+    void copySceneDepth(GLuint source, int width, int height) {
+        if (width != depthWidth || height != depthHeight) {
+            if (depthCopy) glDeleteTextures(1, &depthCopy);
+            if (!depthFBO) glCreateFramebuffers(1, &depthFBO);
+            glCreateTextures(GL_TEXTURE_2D, 1, &depthCopy);
+            glTextureStorage2D(depthCopy, 1, GL_DEPTH_COMPONENT32F, width, height);
+            glNamedFramebufferTexture(depthFBO, GL_DEPTH_ATTACHMENT, depthCopy, 0);
+            depthWidth = width;
+            depthHeight = height;
+        }
+        glBlitNamedFramebuffer(source, depthFBO, 0, 0, width, height, 0, 0, width, height, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+    }
+
+    // the copy of an earlier frame tightens liveBound once its fence has passed,
+    // then the current count is copied; never waits on the GPU
+    void readBackCount() {
+        if (readbackFence) {
+            GLenum state = glClientWaitSync(readbackFence, 0, 0);
+            if (state != GL_ALREADY_SIGNALED && state != GL_CONDITION_SATISFIED) return;
+            glDeleteSync(readbackFence);
+            readbackFence = nullptr;
+            std::uint32_t count = 0;
+            glGetNamedBufferSubData(readbackBuffer, 0, sizeof(count), &count);
+            liveBound = std::min(capacity, count + emittedSinceReadback);
+        }
+        // after the swap the survivors are counted in aliveCount[current]
+        glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+        glCopyNamedBufferSubData(counterBuffer, readbackBuffer,
+            offsetof(Counters, alive) + current * sizeof(std::uint32_t), 0, sizeof(std::uint32_t));
+        readbackFence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        emittedSinceReadback = 0;
+    }
+
+    void reserveEmitBuffer(std::size_t count) {
+        if (count <= emitCapacity) return;
+        emitCapacity = std::max(count, emitCapacity * 2);
+        if (emitBuffer) glDeleteBuffers(1, &emitBuffer);
+        glCreateBuffers(1, &emitBuffer);
+        glNamedBufferData(emitBuffer, GLsizeiptr(emitCapacity * sizeof(EmitRequest)), nullptr, GL_STREAM_DRAW);
+    }
+
+    // terrain heights over its bounds, sampled bilinearly by the update pass
+    void initHeightField(Terrain* terrain, int resolution) {
+        std::vector<float> heights(static_cast<std::size_t>(resolution) * resolution, -1e30f);
+        glm::vec2 lo(0.0f), size(1.0f);
+        if (terrain) {
+            glm::vec3 min = terrain->getAABBMin();
+            glm::vec3 max = terrain->getAABBMax();
+            lo = glm::vec2(min.x, min.z);
+            size = glm::max(glm::vec2(max.x - min.x, max.z - min.z), glm::vec2(1e-4f));
+            for (int z = 0; z < resolution; ++z) {
+                for (int x = 0; x < resolution; ++x) {
+                    glm::vec2 p = lo + (glm::vec2(x, z) + 0.5f) / float(resolution) * size; // texel centers
+                    heights[static_cast<std::size_t>(z) * resolution + x] = terrain->getHeightAt(p.x, p.y);
+                }
+            }
+        }
+        heightBounds = glm::vec4(lo.x, lo.y, 1.0f / size.x, 1.0f / size.y);
+
+        glCreateTextures(GL_TEXTURE_2D, 1, &heightField);
+        glTextureStorage2D(heightField, 1, GL_R32F, resolution, resolution);
+        glTextureSubImage2D(heightField, 0, 0, 0, resolution, resolution, GL_RED, GL_FLOAT, heights.data());
+        glTextureParameteri(heightField, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTextureParameteri(heightField, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTextureParameteri(heightField, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTextureParameteri(heightField, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    }
+};
@@ -0,0 +1,99 @@
+#pragma once
+#include <GL/glew.h>
+#include <algorithm>
+#include <cstddef>
+#include <unordered_map>
+
+#include "assets.hpp"
+#include "Mesh.hpp"
+
+// All static geometry in one vertex buffer and one index buffer behind a
+// single VAO. Meshes are appended on first use and addressed by their index
+// range and base vertex, which is what indirect draw commands need. Copies
+// of a mesh share its GL buffers and therefore its range. Nothing is freed,
+// the pool only holds geometry that lives as long as the scene.
+class GeometryPool {
+public:
+    struct Range {
+        GLuint firstIndex = 0;
+        GLuint indexCount = 0;
+        GLint baseVertex = 0;
+    };
+
+    GeometryPool() = default;
+    GeometryPool(const GeometryPool&) = delete;
+    GeometryPool& operator=(const GeometryPool&) = delete;
+    ~GeometryPool() { clear(); }
+
+    // range of a mesh, uploaded the first time the mesh is seen
+    const Range& add(const Mesh& mesh) {
+        auto it = ranges.find(mesh.getVAO());
+        if (it != ranges.end()) return it->second;
+
+        if (!VAO) create();
+        reserve(VBO, vertexCapacity, vertexCount + mesh.vertices.size(), sizeof(Vertex));
+        reserve(EBO, indexCapacity, indexCount + mesh.indices.size(), sizeof(GLuint));
+        glNamedBufferSubData(VBO, GLintptr(vertexCount * sizeof(Vertex)),
+            GLsizeiptr(mesh.vertices.size() * sizeof(Vertex)), mesh.vertices.data());
+        glNamedBufferSubData(EBO, GLintptr(indexCount * sizeof(GLuint)),
+            GLsizeiptr(mesh.indices.size() * sizeof(GLuint)), mesh.indices.data());
+
+        Range r;
+        r.firstIndex = static_cast<GLuint>(indexCount);
+        r.indexCount = static_cast<GLuint>(mesh.indices.size());
+        r.baseVertex = static_cast<GLint>(vertexCount);
+        vertexCount += mesh.vertices.size();
+        indexCount += mesh.indices.size();
+        return ranges.emplace(mesh.getVAO(), r).first->second;
+    }
+
+    GLuint getVAO() const { return VAO; }
+    std::size_t getVertexCount() const { return vertexCount; }
+    std::size_t getIndexCount() const { return indexCount; }
+
+    void clear() {
+        if (VBO) glDeleteBuffers(1, &VBO);
+        if (EBO) glDeleteBuffers(1, &EBO);
+        if (VAO) glDeleteVertexArrays(1, &VAO);
+        VAO = VBO = EBO = 0;
+        vertexCapacity = indexCapacity = vertexCount = indexCount = 0;
+        ranges.clear();
+    }
+
+private:
+    GLuint VAO = 0, VBO = 0, EBO = 0;
+    std::size_t vertexCapacity = 0, indexCapacity = 0;
+    std::size_t vertexCount = 0, indexCount = 0;
+    std::unordered_map<GLuint, Range> ranges;   // by the VAO of the source mesh
+
+    // same vertex layout as Mesh
+    void create() {
+        glCreateVertexArrays(1, &VAO);
+        glEnableVertexArrayAttrib(VAO, 0);
+        glVertexArrayAttribFormat(VAO, 0, 3, GL_FLOAT, GL_FALSE, offsetof(Vertex, position));
+        glVertexArrayAttribBinding(VAO, 0, 0);
+        glEnableVertexArrayAttrib(VAO, 1);
+        glVertexArrayAttribFormat(VAO, 1, 2, GL_FLOAT, GL_FALSE, offsetof(Vertex, texcoord));
+        glVertexArrayAttribBinding(VAO, 1, 0);
+        glEnableVertexArrayAttrib(VAO, 2);
+        glVertexArrayAttribFormat(VAO, 2, 3, GL_FLOAT, GL_FALSE, offsetof(Vertex, normal));
+        glVertexArrayAttribBinding(VAO, 2, 0);
+    }
+
+    // grow by doubling, the old contents are copied on the GPU
+    void reserve(GLuint& buffer, std::size_t& capacity, std::size_t needed, std::size_t stride) {
+        if (needed <= capacity) return;
+        std::size_t newCapacity = std::max<std::size_t>({ needed, capacity * 2, 4096 });
+        GLuint grown = 0;
+        glCreateBuffers(1, &grown);
+        glNamedBufferStorage(grown, GLsizeiptr(newCapacity * stride), nullptr, GL_DYNAMIC_STORAGE_BIT);
+        if (buffer) {
+            glCopyNamedBufferSubData(buffer, grown, 0, 0, GLsizeiptr(capacity * stride));
+            glDeleteBuffers(1, &buffer);
+        }
+        buffer = grown;
+        capacity = newCapacity;
+        if (&buffer == &VBO) glVertexArrayVertexBuffer(VAO, 0, VBO, 0, sizeof(Vertex));
+        else glVertexArrayElementBuffer(VAO, EBO);
+    }
+};
@@ -0,0 +1,310 @@
+#pragma once
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <algorithm>
+#include <cfloat>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <unordered_map>
+#include <vector>
+
+#include "Mesh.hpp"
+#include "Model.hpp"
+#include "GeometryPool.hpp"
+#include "OcclusionCulling.hpp"
+#include "RenderQueue.hpp"
+
+// Collects opaque meshes for one frame and draws them from the geometry
+// pool with multi-draw-indirect. Identical meshes (same geometry, texture,
+// shader and primitive) become one command with several instances. Per
+// instance model and normal matrices go to one SSBO, each command reads its
+// own range through gl_BaseInstance. Commands are ordered so that all
+// commands sharing a shader and texture form one glMultiDrawElementsIndirect,
+// i.e. the GL call count depends on the number of textures, not of objects.
+//
+// With an OcclusionCuller the instance counts are written on the GPU: phase 1
+// draws what passes last frame's Hi-Z pyramid, the pyramid is rebuilt from
+// that depth and phase 2 draws what passes it among the rest.
+//
+// flush() can replace every batch's shader by one program (depth only or
+// G-buffer output); redraw() then issues the same commands again with the
+// mesh shaders, e.g. for shading after a depth pre-pass.
+class InstancedRenderer {
+public:
+    static constexpr GLuint InstanceBinding = 8; // must match tex.vert
+
+    struct Instance {
+        glm::mat4 model;
+        glm::mat4 normal;   // inverse transpose, only the 3x3 part is used
+    };
+
+    InstancedRenderer() = default;
+    InstancedRenderer(const InstancedRenderer&) = delete;
+    InstancedRenderer& operator=(const InstancedRenderer&) = delete;
+    ~InstancedRenderer() { clear(); }
+
+    // forget the instances of the previous frame, groups are kept
+    void begin() {
+        for (Group& g : groups) g.instances.clear();
+    }
+
+    void add(Model& model) {
+        model.updateAABBAndModelMatrix();
+        for (Mesh& mesh : model.meshes) add(mesh, model.modelMatrix);
+    }
+
+    void add(Mesh& mesh, const glm::mat4& modelMatrix) {
+        Key key{ &mesh.shader, mesh.getVAO(), mesh.texture_id, mesh.primitive_type };
+        auto [it, inserted] = groupIndex.try_emplace(key, groups.size());
+        if (inserted) {
+            Group g;
+            g.shader = &mesh.shader;
+            g.texture = mesh.texture_id;
+            g.primitive = mesh.primitive_type;
+            g.vao = mesh.getVAO();
+            g.range = pool.add(mesh);
+            glm::vec3 lo(FLT_MAX), hi(-FLT_MAX);
+            for (const Vertex& v : mesh.vertices) {
+                lo = glm::min(lo, v.position);
+                hi = glm::max(hi, v.position);
+            }
+            g.bounds.center = glm::vec4((lo + hi) * 0.5f, 0.0f);
+            g.bounds.extent = glm::vec4((hi - lo) * 0.5f, 0.0f);
+            groups.push_back(std::move(g));
+        }
+        groups[it->second].instances.push_back({ modelMatrix, glm::transpose(glm::inverse(modelMatrix)) });
+    }
+
+    // uploads instances and commands, then one multi-draw per shader and
+    // texture (per phase with occlusion culling); returns the number of GL draw calls.
+    // With a program it is used for every batch instead of the mesh shaders.
+    int flush(const glm::mat4& projection, const glm::mat4& view, const glm::vec3& viewPos,
+        OcclusionCuller* occlusion = nullptr, ShaderProgram* program = nullptr) {
+        // commands of a batch must be contiguous: radix sort on state keys
+        order.clear();
+        culled = false;
+        for (std::uint32_t i = 0; i < groups.size(); ++i) {
+            const Group& g = groups[i];
+            if (g.instances.empty()) continue;
+            order.push_back({ RenderQueue::opaqueKey(g.shader->getID(), g.texture, g.vao, 0.0f), i });
+        }
+        if (order.empty()) return 0;
+        RenderQueue::radixSort(order, scratch);
+
+        bool gpuCulling = occlusion && occlusion->ready();
+        staging.clear();
+        commands.clear();
+        commandIds.clear();
+        bounds.clear();
+        for (const RenderQueue::Item& item : order) {
+            const Group& g = groups[item.payload];
+            DrawCommand c;
+            c.count = g.range.indexCount;
+            c.instanceCount = gpuCulling ? 0 : static_cast<GLuint>(g.instances.size());
+            c.firstIndex = g.range.firstIndex;
+            c.baseVertex = g.range.baseVertex;
+            c.baseInstance = static_cast<GLuint>(staging.size());
+            if (gpuCulling) {
+                commandIds.insert(commandIds.end(), g.instances.size(), static_cast<GLuint>(commands.size()));
+                bounds.push_back(g.bounds);
+            }
+            commands.push_back(c);
+            staging.insert(staging.end(), g.instances.begin(), g.instances.end());
+        }
+
+        if (!gpuCulling) {
+            upload(instanceBuffer, instanceCapacity, staging.data(), staging.size() * sizeof(Instance));
+            upload(commandBuffer, commandCapacity, commands.data(), commands.size() * sizeof(DrawCommand));
+            glBindBufferBase(GL_SHADER_STORAGE_BUFFER, InstanceBinding, instanceBuffer);
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer);
+            int draws = drawBatches(projection, view, viewPos, program);
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+            return draws;
+        }
+
+        // phase 2 appends behind the phase 1 instances of the same command
+        std::size_t n = staging.size();
+        secondCommands = commands;
+        for (DrawCommand& c : secondCommands) c.baseInstance += static_cast<GLuint>(n);
+        upload(inputBuffer, inputCapacity, staging.data(), n * sizeof(Instance));
+        upload(commandIdBuffer, commandIdCapacity, commandIds.data(), n * sizeof(GLuint));
+        upload(boundsBuffer, boundsCapacity, bounds.data(), bounds.size() * sizeof(Bounds));
+        upload(commandBuffer, commandCapacity, commands.data(), commands.size() * sizeof(DrawCommand));
+        upload(secondCommandBuffer, secondCommandCapacity, secondCommands.data(), secondCommands.size() * sizeof(DrawCommand));
+        reserve(instanceBuffer, instanceCapacity, 2 * n * sizeof(Instance));
+        reserve(drawnBuffer, drawnCapacity, n * sizeof(GLuint));
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, InstanceBinding, instanceBuffer);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, OcclusionCuller::InputBinding, inputBuffer);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, OcclusionCuller::CommandIdBinding, commandIdBuffer);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, OcclusionCuller::BoundsBinding, boundsBuffer);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, OcclusionCuller::FirstCommandsBinding, commandBuffer);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, OcclusionCuller::SecondCommandsBinding, secondCommandBuffer);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, OcclusionCuller::DrawnFirstBinding, drawnBuffer);
+
+        glm::mat4 viewProjection = projection * view;
+        GLuint count = static_cast<GLuint>(n);
+        occlusion->cull(1, count, viewProjection);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer);
+        int draws = drawBatches(projection, view, viewPos, program);
+
+        occlusion->buildPyramid();
+        occlusion->cull(2, count, viewProjection);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, secondCommandBuffer);
+        draws += drawBatches(projection, view, viewPos, program);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+        occlusion->endFrame(viewProjection);
+        culled = true;
+        return draws;
+    }
+
+    // the commands of the last flush() again, both phases with the counts the
+    // GPU wrote when it was culled; returns the number of GL draw calls
+    int redraw(const glm::mat4& projection, const glm::mat4& view, const glm::vec3& viewPos,
+        ShaderProgram* program = nullptr) {
+        if (order.empty()) return 0;
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, InstanceBinding, instanceBuffer);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer);
+        int draws = drawBatches(projection, view, viewPos, program);
+        if (culled) {
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, secondCommandBuffer);
+            draws += drawBatches(projection, view, viewPos, program);
+        }
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+        return draws;
+    }
+
+    GeometryPool& getPool() { return pool; }
+
+    void clear() {
+        for (GLuint* b : { &instanceBuffer, &commandBuffer, &inputBuffer, &commandIdBuffer,
+                &boundsBuffer, &secondCommandBuffer, &drawnBuffer }) {
+            if (*b) glDeleteBuffers(1, b);
+            *b = 0;
+        }
+        instanceCapacity = commandCapacity = inputCapacity = commandIdCapacity = 0;
+        boundsCapacity = secondCommandCapacity = drawnCapacity = 0;
+        groups.clear();
+        groupIndex.clear();
+        pool.clear();
+    }
+
+private:
+    // layout fixed by glMultiDrawElementsIndirect
+    struct DrawCommand {
+        GLuint count;
+        GLuint instanceCount;
+        GLuint firstIndex;
+        GLint baseVertex;
+        GLuint baseInstance;
+    };
+
+    // model space box of a group's mesh, std430
+    struct Bounds {
+        glm::vec4 center;
+        glm::vec4 extent;
+    };
+
+    // one multi-draw per shader and texture over the bound indirect buffer
+    int drawBatches(const glm::mat4& projection, const glm::mat4& view, const glm::vec3& viewPos,
+        ShaderProgram* program) {
+        glBindVertexArray(pool.getVAO());
+        int draws = 0;
+        for (std::size_t first = 0; first < order.size();) {
+            const Group& g = groups[order[first].payload];
+            std::size_t last = first + 1;
+            while (last < order.size() && sameState(groups[order[last].payload], g)) ++last;
+
+            ShaderProgram& shader = program ? *program : *g.shader;
+            shader.activate();
+            if (g.texture != 0) {
+                glBindTextureUnit(0, g.texture);
+                shader.setUniform("tex0", 0);
+            }
+            else {
+                glBindTexture(GL_TEXTURE_2D, 0);
+            }
+            shader.setUniform("uP_m", projection);
+            shader.setUniform("uV_m", view);
+            shader.setUniform("uInstanced", 1);
+            shader.setUniform("viewPos", viewPos);
+            glMultiDrawElementsIndirect(g.primitive, GL_UNSIGNED_INT,
+                reinterpret_cast<const void*>(first * sizeof(DrawCommand)), static_cast<GLsizei>(last - first), 0);
+            ++draws;
+            first = last;
+        }
+
+        glBindVertexArray(0);
+        groups[order.front().payload].shader->deactivate();
+        return draws;
+    }
+
+    struct Key {
+        const ShaderProgram* shader;
+        GLuint vao;
+        GLuint texture;
+        GLenum primitive;
+        bool operator==(const Key& o) const {
+            return shader == o.shader && vao == o.vao && texture == o.texture && primitive == o.primitive;
+        }
+    };
+    struct KeyHash {
+        std::size_t operator()(const Key& k) const {
+            std::size_t h = std::hash<const void*>()(k.shader);
+            h ^= (static_cast<std::size_t>(k.vao) << 1) ^ (static_cast<std::size_t>(k.texture) << 21) ^ k.primitive;
+            return h;
+        }
+    };
+    struct Group {
+        ShaderProgram* shader = nullptr;
+        GLuint texture = 0;
+        GLenum primitive = GL_TRIANGLES;
+        GLuint vao = 0;   // source mesh, identifies the geometry
+        GeometryPool::Range range;
+        Bounds bounds;
+        std::vector<Instance> instances;
+    };
+
+    GeometryPool pool;
+    std::vector<Group> groups;
+    std::unordered_map<Key, std::size_t, KeyHash> groupIndex;
+    std::vector<RenderQueue::Item> order, scratch;
+    std::vector<Instance> staging;
+    std::vector<DrawCommand> commands;
+    bool culled = false;   // last flush() ran both occlusion phases
+    GLuint instanceBuffer = 0, commandBuffer = 0;
+    std::size_t instanceCapacity = 0, commandCapacity = 0;   // bytes
+    // GPU occlusion culling: input instances, command of every instance,
+    // bounds per command, phase 2 commands and the phase 1 results
+    std::vector<DrawCommand> secondCommands;
+    std::vector<GLuint> commandIds;
+    std::vector<Bounds> bounds;
+    GLuint inputBuffer = 0, commandIdBuffer = 0, boundsBuffer = 0, secondCommandBuffer = 0, drawnBuffer = 0;
+    std::size_t inputCapacity = 0, commandIdCapacity = 0, boundsCapacity = 0, secondCommandCapacity = 0, drawnCapacity = 0;
+
+    // truncated ids in the sort key can collide, batches compare the real state
+    static bool sameState(const Group& a, const Group& b) {
+        return a.shader == b.shader && a.texture == b.texture && a.primitive == b.primitive;
+    }
+
+    // grow a buffer to at least bytes, the contents are lost when it grows
+    static void reserve(GLuint& buffer, std::size_t& capacity, std::size_t bytes) {
+        if (bytes <= capacity) return;
+        if (buffer) glDeleteBuffers(1, &buffer);
+        capacity = std::max(bytes, capacity * 2);
+        glCreateBuffers(1, &buffer);
+        glNamedBufferData(buffer, GLsizeiptr(capacity), nullptr, GL_STREAM_DRAW);
+    }
+
+    // stream data into a buffer, reallocated when too small and orphaned otherwise
+    static void upload(GLuint& buffer, std::size_t& capacity, const void* data, std::size_t bytes) {
+        if (bytes > capacity) {
+            reserve(buffer, capacity, bytes);
+        }
+        else {
+            // the previous frame may still read the old storage
+            glInvalidateBufferData(buffer);
+        }
+        glNamedBufferSubData(buffer, 0, GLsizeiptr(bytes), data);
+    }
+};
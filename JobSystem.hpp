@@ -0,0 +1,222 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <initializer_list>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Work stealing job system.
+// Every worker owns a deque: it pushes and pops its own jobs at the back
+// (LIFO, cache warm) and steals from the front of other deques when it runs
+// dry. Jobs can depend on other jobs, a job runs once all its dependencies
+// have finished. There is always at least one worker, so jobs started with
+// run() finish without help from the caller. A thread outside the system
+// waiting in parallelFor() only helps with chunks: a long run() job (a flow
+// field integration) is left to the workers instead of stalling the frame.
+class JobSystem {
+public:
+    class Job;
+    using Handle = std::shared_ptr<Job>;
+
+    class Job {
+    public:
+        bool done() const { return finished.load(std::memory_order_acquire); }
+
+    private:
+        friend class JobSystem;
+        std::function<void()> fn;
+        bool chunk = false;                    // parallelFor() slice, short
+        std::atomic<int> pending{ 1 };         // unfinished dependencies + 1 while registering
+        std::atomic<bool> finished{ false };
+        std::mutex lock;                       // guards continuations
+        std::vector<Handle> continuations;     // jobs waiting on this one
+    };
+
+    // threads = 0: one worker per hardware thread minus the main thread, at least one
+    explicit JobSystem(unsigned threads = 0) {
+        if (threads == 0) threads = std::max(2u, std::thread::hardware_concurrency()) - 1;
+        queues.reserve(threads + 1);
+        // queue 0 belongs to the main (or any external) thread
+        for (unsigned i = 0; i <= threads; ++i) queues.push_back(std::make_unique<WorkQueue>());
+        for (unsigned i = 1; i <= threads; ++i) workers.emplace_back([this, i] { workerLoop(i); });
+    }
+
+    JobSystem(const JobSystem&) = delete;
+    JobSystem& operator=(const JobSystem&) = delete;
+
+    ~JobSystem() {
+        {
+            std::lock_guard<std::mutex> guard(sleepLock);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (auto& t : workers) t.join();
+    }
+
+    std::size_t workerCount() const { return workers.size(); }
+
+    // run fn once every job in deps has finished
+    Handle run(std::function<void()> fn, std::initializer_list<Handle> deps = {}) {
+        return submit(std::move(fn), deps.begin(), deps.end());
+    }
+    Handle run(std::function<void()> fn, const std::vector<Handle>& deps) {
+        return submit(std::move(fn), deps.data(), deps.data() + deps.size());
+    }
+
+    // block until job has finished, the caller runs other jobs meanwhile
+    void wait(const Handle& job) {
+        while (!job->done()) {
+            if (!runOne(threadIndex())) std::this_thread::yield();
+        }
+    }
+
+    void wait(const std::vector<Handle>& jobs) {
+        for (const auto& job : jobs) wait(job);
+    }
+
+    // fn(first, last) over [begin, end) in chunks of at most grain items,
+    // returns when all chunks are done
+    template<typename Fn>
+    void parallelFor(std::size_t begin, std::size_t end, std::size_t grain, Fn&& fn) {
+        if (begin >= end) return;
+        grain = std::max<std::size_t>(1, grain);
+        if (end - begin <= grain) {
+            fn(begin, end);
+            return;
+        }
+        // shared countdown instead of one handle per chunk
+        std::atomic<std::size_t> remaining{ (end - begin + grain - 1) / grain };
+        for (std::size_t first = begin + grain; first < end; first += grain) {
+            std::size_t last = std::min(first + grain, end);
+            push(std::make_shared<Job>(), [&fn, &remaining, first, last] {
+                fn(first, last);
+                remaining.fetch_sub(1, std::memory_order_acq_rel);
+            });
+        }
+        fn(begin, std::min(begin + grain, end));
+        remaining.fetch_sub(1, std::memory_order_acq_rel);
+        // workers may help with anything, other threads only with chunks
+        std::size_t self = threadIndex();
+        while (remaining.load(std::memory_order_acquire) > 0) {
+            if (!runOne(self, self == 0)) std::this_thread::yield();
+        }
+    }
+
+private:
+    struct WorkQueue {
+        std::mutex lock;
+        std::deque<Handle> jobs;
+    };
+
+    std::vector<std::unique_ptr<WorkQueue>> queues;
+    std::vector<std::thread> workers;
+    std::atomic<int> queued{ 0 };
+    std::mutex sleepLock;
+    std::condition_variable wake;
+    bool stopping = false;
+
+    // 0 for threads that are not workers of this system
+    std::size_t threadIndex() const {
+        return currentSystem() == this ? currentIndex() : 0;
+    }
+    static const JobSystem*& currentSystem() { thread_local const JobSystem* system = nullptr; return system; }
+    static std::size_t& currentIndex() { thread_local std::size_t index = 0; return index; }
+
+    template<typename It>
+    Handle submit(std::function<void()> fn, It depBegin, It depEnd) {
+        Handle job = std::make_shared<Job>();
+        job->fn = std::move(fn);
+        for (It it = depBegin; it != depEnd; ++it) {
+            const Handle& dep = *it;
+            if (!dep) continue;
+            std::lock_guard<std::mutex> guard(dep->lock);
+            if (dep->done()) continue;
+            job->pending.fetch_add(1, std::memory_order_relaxed);
+            dep->continuations.push_back(job);
+        }
+        release(job);
+        return job;
+    }
+
+    // drops one pending count, queues the job when nothing is left
+    void release(const Handle& job) {
+        if (job->pending.fetch_sub(1, std::memory_order_acq_rel) != 1) return;
+        enqueue(job);
+    }
+
+    void enqueue(const Handle& job) {
+        WorkQueue& q = *queues[threadIndex()];
+        {
+            std::lock_guard<std::mutex> guard(q.lock);
+            q.jobs.push_back(job);
+        }
+        queued.fetch_add(1, std::memory_order_release);
+        // empty critical section: a worker between its check and wait() cannot miss the notify
+        { std::lock_guard<std::mutex> guard(sleepLock); }
+        wake.notify_one();
+    }
+
+    // internal chunk job without dependency tracking
+    void push(Handle job, std::function<void()> fn) {
+        job->fn = std::move(fn);
+        job->chunk = true;
+        job->pending.store(0, std::memory_order_relaxed);
+        enqueue(job);
+    }
+
+    void execute(const Handle& job) {
+        job->fn();
+        job->fn = nullptr; // release captures early
+        std::vector<Handle> next;
+        {
+            std::lock_guard<std::mutex> guard(job->lock);
+            job->finished.store(true, std::memory_order_release);
+            next.swap(job->continuations);
+        }
+        for (auto& n : next) release(n);
+    }
+
+    // pop own work first (newest), then steal the oldest job of another queue;
+    // chunksOnly skips run() jobs
+    bool runOne(std::size_t self, bool chunksOnly = false) {
+        Handle job = take(*queues[self], true, chunksOnly);
+        for (std::size_t i = 1; !job && i < queues.size(); ++i) {
+            job = take(*queues[(self + i) % queues.size()], false, chunksOnly);
+        }
+        if (!job) return false;
+        queued.fetch_sub(1, std::memory_order_acq_rel);
+        execute(job);
+        return true;
+    }
+
+    // newest or oldest job of q, the first chunk from that end with chunksOnly
+    Handle take(WorkQueue& q, bool newest, bool chunksOnly) {
+        std::lock_guard<std::mutex> guard(q.lock);
+        std::size_t n = q.jobs.size();
+        for (std::size_t k = 0; k < n; ++k) {
+            std::size_t i = newest ? n - 1 - k : k;
+            if (chunksOnly && !q.jobs[i]->chunk) continue;
+            Handle job = std::move(q.jobs[i]);
+            q.jobs.erase(q.jobs.begin() + static_cast<std::ptrdiff_t>(i));
+            return job;
+        }
+        return nullptr;
+    }
+
+    void workerLoop(std::size_t index) {
+        currentSystem() = this;
+        currentIndex() = index;
+        for (;;) {
+            if (runOne(index)) continue;
+            std::unique_lock<std::mutex> guard(sleepLock);
+            wake.wait(guard, [this] { return stopping || queued.load(std::memory_order_acquire) > 0; });
+            if (stopping) return;
+        }
+    }
+};
@@ -0,0 +1,299 @@
+#pragma once
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <vector>
+
+#include "JobSystem.hpp"
+#include "Lights.hpp"
+
+// Clustered forward lighting. The view frustum is split into screen tiles of
+// a fixed pixel size and exponentially spaced depth slices; every cluster
+// gets the list of point and spot lights whose range (from the attenuation
+// terms) overlaps its view space box. tex.frag finds the cluster of a
+// fragment and only shades with the lights in that list.
+//
+// Lists are built on the CPU: light bounds in parallel over the lights, then
+// the clusters in parallel over the depth slices. A slice owns its clusters,
+// so workers never write to the same list.
+class LightClusters {
+public:
+    // must match the shaders
+    static constexpr GLuint ParamsBinding = 1;    // uniform block
+    static constexpr GLuint GridBinding = 11;     // storage buffer, one entry per cluster
+    static constexpr GLuint IndexBinding = 12;    // storage buffer, light indices
+
+    LightClusters() = default;
+    LightClusters(const LightClusters&) = delete;
+    LightClusters& operator=(const LightClusters&) = delete;
+    ~LightClusters() { clear(); }
+
+    // rebuild the cluster boxes, called whenever the projection changes
+    void setProjection(const glm::mat4& projection, float zNear, float zFar, int width, int height,
+        int tileSize = 64, int slices = 24) {
+        tile = std::max(tileSize, 8);
+        tilesX = (std::max(width, 1) + tile - 1) / tile;
+        tilesY = (std::max(height, 1) + tile - 1) / tile;
+        tilesZ = std::max(slices, 1);
+        nearPlane = zNear;
+        farPlane = zFar;
+        sliceScale = tilesZ / std::log(zFar / zNear);
+        sliceBias = -std::log(zNear) * sliceScale;
+        scaleX = projection[0][0];
+        scaleY = projection[1][1];
+        viewportX = float(tilesX * tile) / std::max(width, 1);
+        viewportY = float(tilesY * tile) / std::max(height, 1);
+
+        // view space box of every cluster
+        boxes.resize(std::size_t(tilesX) * tilesY * tilesZ);
+        for (int z = 0; z < tilesZ; ++z) {
+            float dn = sliceDepth(z), df = sliceDepth(z + 1);
+            for (int y = 0; y < tilesY; ++y) {
+                float y0 = tileNDC(y, tilesY, viewportY), y1 = tileNDC(y + 1, tilesY, viewportY);
+                for (int x = 0; x < tilesX; ++x) {
+                    float x0 = tileNDC(x, tilesX, viewportX), x1 = tileNDC(x + 1, tilesX, viewportX);
+                    Box& b = boxes[index(x, y, z)];
+                    b.min = glm::vec3(std::min(x0 * dn, x0 * df) / scaleX, std::min(y0 * dn, y0 * df) / scaleY, -df);
+                    b.max = glm::vec3(std::max(x1 * dn, x1 * df) / scaleX, std::max(y1 * dn, y1 * df) / scaleY, -dn);
+                }
+            }
+        }
+        grid.assign(boxes.size(), Cluster{});
+        paramsDirty = true;
+    }
+
+    // assign the lights to clusters; returns the total length of all lists
+    std::size_t build(const Lights& lights, const glm::mat4& view, JobSystem& jobs) {
+        std::size_t pointCount = lights.pointLights.size();
+        bounds.resize(pointCount + lights.spotLights.size());
+        jobs.parallelFor(0, bounds.size(), 256, [&](std::size_t first, std::size_t last) {
+            for (std::size_t i = first; i < last; ++i) {
+                if (i < pointCount) {
+                    const PointLight& p = lights.pointLights[i];
+                    bounds[i] = lightBounds(view, p.position, range(p, p.constant, p.linear, p.quadratic));
+                }
+                else {
+                    // bounding sphere of the cone is the sphere of the range
+                    const SpotLight& s = lights.spotLights[i - pointCount];
+                    bounds[i] = lightBounds(view, s.position, range(s, s.constant, s.linear, s.quadratic));
+                }
+            }
+        });
+
+        slices.resize(tilesZ);
+        jobs.parallelFor(0, std::size_t(tilesZ), 1, [&](std::size_t first, std::size_t last) {
+            for (std::size_t z = first; z < last; ++z) buildSlice(int(z), pointCount);
+        });
+
+        // slice lists are contiguous in the index buffer, offsets become global
+        indices.clear();
+        for (int z = 0; z < tilesZ; ++z) {
+            std::uint32_t base = static_cast<std::uint32_t>(indices.size());
+            Cluster* c = &grid[index(0, 0, z)];
+            for (int i = 0; i < tilesX * tilesY; ++i) c[i].offset += base;
+            indices.insert(indices.end(), slices[z].indices.begin(), slices[z].indices.end());
+        }
+        if (indices.empty()) indices.push_back(0);   // storage buffers cannot be empty
+        return indices.size();
+    }
+
+    void upload() {
+        if (paramsDirty) {
+            Params p{};
+            p.grid = glm::uvec4(tilesX, tilesY, tilesZ, tile);
+            p.depth = glm::vec4(nearPlane, farPlane, sliceScale, sliceBias);
+            if (!paramsBuffer) {
+                glCreateBuffers(1, &paramsBuffer);
+                glNamedBufferStorage(paramsBuffer, sizeof(Params), nullptr, GL_DYNAMIC_STORAGE_BIT);
+            }
+            glNamedBufferSubData(paramsBuffer, 0, sizeof(Params), &p);
+            paramsDirty = false;
+        }
+        stream(gridBuffer, gridCapacity, grid.data(), grid.size() * sizeof(Cluster));
+        stream(indexBuffer, indexCapacity, indices.data(), indices.size() * sizeof(std::uint32_t));
+    }
+
+    void bind() const {
+        glBindBufferBase(GL_UNIFORM_BUFFER, ParamsBinding, paramsBuffer);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, GridBinding, gridBuffer);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, IndexBinding, indexBuffer);
+    }
+
+    std::size_t clusterCount() const { return grid.size(); }
+
+    void clear() {
+        if (paramsBuffer) glDeleteBuffers(1, &paramsBuffer);
+        if (gridBuffer) glDeleteBuffers(1, &gridBuffer);
+        if (indexBuffer) glDeleteBuffers(1, &indexBuffer);
+        paramsBuffer = gridBuffer = indexBuffer = 0;
+        gridCapacity = indexCapacity = 0;
+        paramsDirty = true;
+    }
+
+    // distance at which the light drops below 1/256 of its brightest channel,
+    // infinite when it does not fall off at all
+    static float range(const LightSource& light, float constant, float linear, float quadratic) {
+        glm::vec3 peak = glm::max(light.ambient, glm::max(light.diffuse, light.specular));
+        float k = 256.0f * std::max({ peak.x, peak.y, peak.z });
+        if (k <= constant) return 0.0f;
+        if (quadratic > 0.0f) {
+            return (-linear + std::sqrt(linear * linear - 4.0f * quadratic * (constant - k))) / (2.0f * quadratic);
+        }
+        if (linear > 0.0f) return (k - constant) / linear;
+        return std::numeric_limits<float>::infinity();
+    }
+
+private:
+    struct Box {
+        glm::vec3 min, max;
+    };
+    // std430 uvec4, lists hold point lights first, then spot lights
+    struct Cluster {
+        std::uint32_t offset = 0;
+        std::uint32_t pointCount = 0;
+        std::uint32_t spotCount = 0;
+        std::uint32_t pad = 0;
+    };
+    // std140
+    struct Params {
+        glm::uvec4 grid;    // tiles x, y, slices, tile size in pixels
+        glm::vec4 depth;    // near, far, slice scale, slice bias
+    };
+    struct Bounds {
+        glm::vec3 center;   // view space
+        float radius = 0.0f;
+        int x0 = 0, x1 = -1, y0 = 0, y1 = -1, z0 = 0, z1 = -1;   // inclusive, empty when x1 < x0
+    };
+    struct Slice {
+        std::vector<std::uint64_t> hits;   // cluster << 33 | spot << 32 | light
+        std::vector<std::uint32_t> indices;
+        std::vector<std::uint32_t> counts;
+    };
+
+    int tile = 64, tilesX = 1, tilesY = 1, tilesZ = 1;
+    float nearPlane = 0.1f, farPlane = 100.0f;
+    float sliceScale = 1.0f, sliceBias = 0.0f;
+    float scaleX = 1.0f, scaleY = 1.0f;            // projection[0][0], projection[1][1]
+    float viewportX = 1.0f, viewportY = 1.0f;      // tiled area / viewport, last tiles overhang
+    std::vector<Box> boxes;
+    std::vector<Cluster> grid;
+    std::vector<std::uint32_t> indices;
+    std::vector<Bounds> bounds;
+    std::vector<Slice> slices;
+
+    GLuint paramsBuffer = 0, gridBuffer = 0, indexBuffer = 0;
+    std::size_t gridCapacity = 0, indexCapacity = 0;   // bytes
+    bool paramsDirty = true;
+
+    std::size_t index(int x, int y, int z) const {
+        return std::size_t(x) + std::size_t(tilesX) * (std::size_t(y) + std::size_t(tilesY) * z);
+    }
+
+    float sliceDepth(int z) const {
+        return nearPlane * std::pow(farPlane / nearPlane, float(z) / tilesZ);
+    }
+
+    int depthSlice(float depth) const {
+        if (depth <= nearPlane) return 0;
+        if (depth >= farPlane) return tilesZ - 1;
+        return std::clamp(int(std::floor(std::log(depth) * sliceScale + sliceBias)), 0, tilesZ - 1);
+    }
+
+    // left/bottom edge of tile i in NDC
+    static float tileNDC(int i, int tiles, float coverage) {
+        return -1.0f + 2.0f * coverage * float(i) / tiles;
+    }
+
+    int ndcTile(float ndc, int tiles, float coverage) const {
+        return std::clamp(int(std::floor((ndc + 1.0f) * 0.5f * tiles / coverage)), 0, tiles - 1);
+    }
+
+    // view space sphere and the conservative range of clusters it can touch
+    Bounds lightBounds(const glm::mat4& view, const glm::vec3& position, float radius) const {
+        Bounds b;
+        b.center = glm::vec3(view * glm::vec4(position, 1.0f));
+        b.radius = radius;
+        float depth = -b.center.z;
+        if (radius <= 0.0f || depth + radius < nearPlane || depth - radius > farPlane) return b;
+
+        b.z0 = depthSlice(depth - radius);
+        b.z1 = depthSlice(depth + radius);
+        b.x0 = 0; b.x1 = tilesX - 1;
+        b.y0 = 0; b.y1 = tilesY - 1;
+        // in front of the near plane: project the box around the sphere
+        float dMin = depth - radius;
+        if (std::isfinite(radius) && dMin > nearPlane) {
+            float dMax = depth + radius;
+            float xl = b.center.x - radius, xr = b.center.x + radius;
+            float yb = b.center.y - radius, yt = b.center.y + radius;
+            float nx0 = scaleX * std::min(xl / dMin, xl / dMax), nx1 = scaleX * std::max(xr / dMin, xr / dMax);
+            float ny0 = scaleY * std::min(yb / dMin, yb / dMax), ny1 = scaleY * std::max(yt / dMin, yt / dMax);
+            if (nx1 < -1.0f || nx0 > 1.0f || ny1 < -1.0f || ny0 > 1.0f) {
+                b.x1 = b.x0 - 1;   // off screen
+                return b;
+            }
+            b.x0 = ndcTile(nx0, tilesX, viewportX); b.x1 = ndcTile(nx1, tilesX, viewportX);
+            b.y0 = ndcTile(ny0, tilesY, viewportY); b.y1 = ndcTile(ny1, tilesY, viewportY);
+        }
+        return b;
+    }
+
+    static bool overlaps(const Box& box, const Bounds& b) {
+        if (!std::isfinite(b.radius)) return true;
+        glm::vec3 d = glm::max(box.min - b.center, glm::max(glm::vec3(0.0f), b.center - box.max));
+        return glm::dot(d, d) <= b.radius * b.radius;
+    }
+
+    // lists of one depth slice, counting sorted by cluster with point lights first
+    void buildSlice(int z, std::size_t pointCount) {
+        Slice& s = slices[z];
+        s.hits.clear();
+        for (std::size_t i = 0; i < bounds.size(); ++i) {
+            const Bounds& b = bounds[i];
+            if (z < b.z0 || z > b.z1 || b.x1 < b.x0) continue;
+            std::uint64_t light = i < pointCount ? i : (std::uint64_t(1) << 32) | (i - pointCount);
+            for (int y = b.y0; y <= b.y1; ++y) {
+                for (int x = b.x0; x <= b.x1; ++x) {
+                    std::size_t c = index(x, y, z);
+                    if (overlaps(boxes[c], b)) s.hits.push_back((std::uint64_t(c) << 33) | light);
+                }
+            }
+        }
+
+        std::size_t first = index(0, 0, z), tiles = std::size_t(tilesX) * tilesY;
+        s.counts.assign(tiles * 2, 0);
+        for (std::uint64_t h : s.hits) s.counts[((h >> 33) - first) * 2 + ((h >> 32) & 1)]++;
+        std::uint32_t sum = 0;
+        for (std::size_t t = 0; t < tiles; ++t) {
+            Cluster& c = grid[first + t];
+            c.offset = sum;
+            c.pointCount = s.counts[t * 2];
+            c.spotCount = s.counts[t * 2 + 1];
+            s.counts[t * 2] = sum;
+            s.counts[t * 2 + 1] = sum + c.pointCount;
+            sum += c.pointCount + c.spotCount;
+        }
+        s.indices.resize(sum);
+        for (std::uint64_t h : s.hits) {
+            s.indices[s.counts[((h >> 33) - first) * 2 + ((h >> 32) & 1)]++] = static_cast<std::uint32_t>(h);
+        }
+    }
+
+    // stream data into a buffer, reallocated when too small and orphaned otherwise
+    static void stream(GLuint& buffer, std::size_t& capacity, const void* data, std::size_t bytes) {
+        if (bytes > capacity) {
+            if (buffer) glDeleteBuffers(1, &buffer);
+            capacity = std::max(bytes, capacity * 2);
+            glCreateBuffers(1, &buffer);
+            glNamedBufferData(buffer, GLsizeiptr(capacity), nullptr, GL_STREAM_DRAW);
+        }
+        else {
+            glInvalidateBufferData(buffer);
+        }
+        glNamedBufferSubData(buffer, 0, GLsizeiptr(bytes), data);
+    }
+};
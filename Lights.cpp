@@ -1,5 +1,6 @@
 #include "Lights.hpp"
 #include <glm/gtc/type_ptr.hpp>
+#include <algorithm>
 
 // Factory methods
 DirectionalLight DirectionalLight::createDefault() {
@@ -95,4 +96,87 @@ void Lights::initSpotLight(const glm::vec3& pos, const glm::vec3& dir) {
 
 void Lights::initAmbientLight(const glm::vec3& color) {
     ambientLight = AmbientLight::createDefault(color);
-};
\ No newline at end of file
+};
+
+// packs the lights, writes only what differs from the last upload
+std::size_t LightBuffer::upload(const Lights& lights) {
+    std::size_t bytes = 0;
+
+    SceneGPU s{};
+    s.ambientColor = glm::vec4(lights.ambientLight.color, 0.0f);
+    s.sunDirection = glm::vec4(lights.sun.direction, 0.0f);
+    s.sunAmbient = glm::vec4(lights.sun.ambient, 0.0f);
+    s.sunDiffuse = glm::vec4(lights.sun.diffuse, 0.0f);
+    s.sunSpecular = glm::vec4(lights.sun.specular, 0.0f);
+    s.counts = glm::ivec4(static_cast<int>(lights.pointLights.size()), static_cast<int>(lights.spotLights.size()), 0, 0);
+    if (!sceneBuffer) {
+        glCreateBuffers(1, &sceneBuffer);
+        glNamedBufferStorage(sceneBuffer, sizeof(SceneGPU), nullptr, GL_DYNAMIC_STORAGE_BIT);
+    }
+    if (!sceneValid || std::memcmp(&s, &scene, sizeof(SceneGPU)) != 0) {
+        scene = s;
+        sceneValid = true;
+        glNamedBufferSubData(sceneBuffer, 0, sizeof(SceneGPU), &scene);
+        bytes += sizeof(SceneGPU);
+    }
+
+    packedPoints.clear();
+    for (const PointLight& p : lights.pointLights) {
+        packedPoints.push_back({ glm::vec4(p.position, p.constant), glm::vec4(p.ambient, p.linear),
+            glm::vec4(p.diffuse, p.quadratic), glm::vec4(p.specular, 0.0f) });
+    }
+    packedSpots.clear();
+    for (const SpotLight& l : lights.spotLights) {
+        packedSpots.push_back({ glm::vec4(l.position, l.cutOff), glm::vec4(l.direction, l.outerCutOff),
+            glm::vec4(l.ambient, l.constant), glm::vec4(l.diffuse, l.linear), glm::vec4(l.specular, l.quadratic) });
+    }
+    bytes += sync(pointBuffer, pointCapacity, points, packedPoints);
+    bytes += sync(spotBuffer, spotCapacity, spots, packedSpots);
+    return bytes;
+}
+
+// sent mirrors the buffer contents; runs of changed elements become one write each
+template<typename T>
+std::size_t LightBuffer::sync(GLuint& buffer, std::size_t& capacity, std::vector<T>& sent, const std::vector<T>& packed) {
+    // storage buffers cannot be empty, keep at least one element
+    std::size_t needed = std::max<std::size_t>(packed.size(), 1);
+    if (needed > capacity) {
+        if (buffer) glDeleteBuffers(1, &buffer);
+        capacity = std::max(needed, capacity * 2);
+        glCreateBuffers(1, &buffer);
+        glNamedBufferStorage(buffer, GLsizeiptr(capacity * sizeof(T)), nullptr, GL_DYNAMIC_STORAGE_BIT);
+        sent.clear(); // new storage, everything is dirty
+    }
+
+    std::size_t bytes = 0;
+    std::size_t i = 0;
+    while (i < packed.size()) {
+        if (i < sent.size() && std::memcmp(&sent[i], &packed[i], sizeof(T)) == 0) {
+            ++i;
+            continue;
+        }
+        std::size_t first = i;
+        while (i < packed.size() && (i >= sent.size() || std::memcmp(&sent[i], &packed[i], sizeof(T)) != 0)) ++i;
+        glNamedBufferSubData(buffer, GLintptr(first * sizeof(T)), GLsizeiptr((i - first) * sizeof(T)), &packed[first]);
+        bytes += (i - first) * sizeof(T);
+    }
+    sent = packed;
+    return bytes;
+}
+
+void LightBuffer::bind() const {
+    glBindBufferBase(GL_UNIFORM_BUFFER, SceneBinding, sceneBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, PointBinding, pointBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, SpotBinding, spotBuffer);
+}
+
+void LightBuffer::clear() {
+    if (sceneBuffer) glDeleteBuffers(1, &sceneBuffer);
+    if (pointBuffer) glDeleteBuffers(1, &pointBuffer);
+    if (spotBuffer) glDeleteBuffers(1, &spotBuffer);
+    sceneBuffer = pointBuffer = spotBuffer = 0;
+    pointCapacity = spotCapacity = 0;
+    sceneValid = false;
+    points.clear();
+    spots.clear();
+}
@@ -1,5 +1,6 @@
 #pragma once
 #include <glm/glm.hpp>
+#include <cstring>
 #include <vector>
 #include <string>
 #include <GL/glew.h>
@@ -110,4 +111,60 @@ struct Lights {
     void initPointLight(const glm::vec3& position, const glm::vec3& color);
     void initSpotLight(const glm::vec3& pos, const glm::vec3& dir);
     void initAmbientLight(const glm::vec3& color = glm::vec3(0.5f, 0.4f, 0.1f));
+};
+
+// GPU copy of Lights shared by every program: ambient, sun and light counts
+// in a std140 uniform block, point and spot lights in std430 storage buffers
+// without a fixed maximum. upload() packs the lights and compares them with
+// what was sent last time, only changed runs of lights are written.
+class LightBuffer {
+public:
+    // must match the shaders
+    static constexpr GLuint SceneBinding = 0;    // uniform block
+    static constexpr GLuint PointBinding = 9;    // storage buffer
+    static constexpr GLuint SpotBinding = 10;    // storage buffer
+
+    LightBuffer() = default;
+    LightBuffer(const LightBuffer&) = delete;
+    LightBuffer& operator=(const LightBuffer&) = delete;
+    ~LightBuffer() { clear(); }
+
+    // returns the number of bytes written
+    std::size_t upload(const Lights& lights);
+    // binds all three buffers to their binding points
+    void bind() const;
+    void clear();
+
+private:
+    struct SceneGPU {
+        glm::vec4 ambientColor;
+        glm::vec4 sunDirection;
+        glm::vec4 sunAmbient;
+        glm::vec4 sunDiffuse;
+        glm::vec4 sunSpecular;
+        glm::ivec4 counts;       // point lights, spot lights
+    };
+    struct PointLightGPU {
+        glm::vec4 position;      // w = constant
+        glm::vec4 ambient;       // w = linear
+        glm::vec4 diffuse;       // w = quadratic
+        glm::vec4 specular;
+    };
+    struct SpotLightGPU {
+        glm::vec4 position;      // w = cutOff
+        glm::vec4 direction;     // w = outerCutOff
+        glm::vec4 ambient;       // w = constant
+        glm::vec4 diffuse;       // w = linear
+        glm::vec4 specular;      // w = quadratic
+    };
+
+    GLuint sceneBuffer = 0, pointBuffer = 0, spotBuffer = 0;
+    std::size_t pointCapacity = 0, spotCapacity = 0;
+    bool sceneValid = false;
+    SceneGPU scene{};
+    std::vector<PointLightGPU> points, packedPoints;
+    std::vector<SpotLightGPU> spots, packedSpots;
+
+    template<typename T>
+    static std::size_t sync(GLuint& buffer, std::size_t& capacity, std::vector<T>& sent, const std::vector<T>& packed);
 };
\ No newline at end of file
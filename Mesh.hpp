@@ -2,6 +2,7 @@
 
 #include <string>
 #include <vector>
+#include <memory>
 #include <iostream>
 
 #include <glm/glm.hpp> 
@@ -10,6 +11,7 @@
 #include "assets.hpp"
 #include "ShaderProgram.hpp"
 #include "Lights.hpp"
+#include "MeshBVH.hpp"
 
 class Mesh {
 public:
@@ -31,12 +33,20 @@ public:
     std::vector<Vertex> vertices;
     std::vector<GLuint> indices;
 
+    // optional triangle BVH for ray queries (shared by copies of the mesh)
+    std::shared_ptr<const MeshBVH> bvh;
+
+    // false: keep CPU data only, no GL objects are created (headless simulation)
+    static inline bool uploadToGPU = true;
+
     // indirect (indexed) draw 
     Mesh(GLenum primitive_type, ShaderProgram& shader, std::vector<Vertex> const& vertices, std::vector<GLuint> const& indices,
         glm::vec3 const& origin, glm::vec3 const& orientation, GLuint const texture_id = 0)
         : primitive_type(primitive_type), shader(shader), vertices(vertices), indices(indices),
         origin(origin), orientation(orientation), texture_id(texture_id)
     {
+        if (!uploadToGPU) return;
+
         // Create buffers and VAO using DSA
         glCreateVertexArrays(1, &VAO);
         glCreateBuffers(1, &VBO);
@@ -84,6 +94,7 @@ public:
         shader.setUniform("uP_m", projection);
         shader.setUniform("uV_m", view);
         shader.setUniform("uM_m", model);
+        shader.setUniform("uInstanced", 0);
 
         shader.setUniform("viewPos", viewPos);
 
@@ -94,9 +105,18 @@ public:
         shader.deactivate();
     }
 
+    // GL vertex array, shared by copies of the mesh; identifies the geometry
+    GLuint getVAO() const { return VAO; }
 
 
 
+
+    // build the ray query BVH from the CPU copy of the geometry
+    void buildBVH() {
+        if (primitive_type != GL_TRIANGLES || indices.size() < 3) return;
+        bvh = std::make_shared<const MeshBVH>(vertices, indices);
+    }
+
     void clear(void) {
         // clear texture
         if (texture_id != 0) {
@@ -108,6 +128,7 @@ public:
         // clear rest of the member variables to safe default
         vertices.clear();
         indices.clear();
+        bvh.reset();
         origin = glm::vec3(0.0f);
         orientation = glm::vec3(0.0f);
 
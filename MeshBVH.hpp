@@ -0,0 +1,317 @@
+#pragma once
+#include <glm/glm.hpp>
+#include <GL/glew.h>
+#include <algorithm>
+#include <cassert>
+#include <cfloat>
+#include <cstdint>
+#include <vector>
+
+#include "assets.hpp"
+#include "AABBTree.hpp"
+
+struct Ray {
+    glm::vec3 origin{ 0.0f };
+    glm::vec3 direction{ 0.0f, 0.0f, -1.0f }; // need not be normalized, t is in its units
+};
+
+struct RayHit {
+    float t = FLT_MAX;                 // closest hit so far, also the query range
+    std::uint32_t primitive = UINT32_MAX; // triangle index within the mesh
+    std::uint32_t mesh = UINT32_MAX;      // mesh index within the model (Model::raycast)
+    float u = 0.0f, v = 0.0f;          // barycentrics of the hit triangle
+
+    bool valid() const { return primitive != UINT32_MAX; }
+};
+
+// Flattened bounding volume hierarchy built with binned SAH splits.
+namespace BVH {
+    // 32 bytes: two nodes per cache line
+    struct Node {
+        glm::vec3 min;
+        std::uint32_t leftFirst; // first primitive (leaf) or left child, right child is leftFirst + 1
+        glm::vec3 max;
+        std::uint32_t count;     // primitives in a leaf, 0 for inner nodes
+
+        bool isLeaf() const { return count > 0; }
+    };
+
+    constexpr int Bins = 12;
+    constexpr int MaxStack = 64;
+    constexpr int MaxPacket = 64; // rays per packet, one bit each in the active mask
+
+    // slab test, returns entry distance or FLT_MAX on miss
+    inline float intersectBox(const glm::vec3& bmin, const glm::vec3& bmax,
+        const glm::vec3& origin, const glm::vec3& invDir, float tMax) {
+        glm::vec3 t1 = (bmin - origin) * invDir;
+        glm::vec3 t2 = (bmax - origin) * invDir;
+        glm::vec3 tLo = glm::min(t1, t2);
+        glm::vec3 tHi = glm::max(t1, t2);
+        float tNear = std::max(std::max(tLo.x, tLo.y), std::max(tLo.z, 0.0f));
+        float tFar = std::min(std::min(tHi.x, tHi.y), std::min(tHi.z, tMax));
+        return tNear <= tFar ? tNear : FLT_MAX;
+    }
+
+    inline glm::vec3 inverseDirection(const glm::vec3& d) {
+        // huge instead of inf keeps the slab test free of NaNs (0 * inf)
+        auto inv = [](float x) { return std::abs(x) > 1e-12f ? 1.0f / x : (x < 0.0f ? -1e30f : 1e30f); };
+        return glm::vec3(inv(d.x), inv(d.y), inv(d.z));
+    }
+
+    // builds nodes over primitive bounds, order receives the primitive permutation
+    inline void build(const std::vector<AABB>& bounds, std::vector<Node>& nodes, std::vector<std::uint32_t>& order) {
+        const std::uint32_t n = static_cast<std::uint32_t>(bounds.size());
+        nodes.clear();
+        order.resize(n);
+        for (std::uint32_t i = 0; i < n; ++i) order[i] = i;
+        if (n == 0) return;
+
+        std::vector<glm::vec3> centroid(n);
+        for (std::uint32_t i = 0; i < n; ++i) centroid[i] = (bounds[i].min + bounds[i].max) * 0.5f;
+
+        nodes.reserve(2 * n);
+        nodes.push_back(Node{ glm::vec3(0.0f), 0, glm::vec3(0.0f), n });
+
+        auto refit = [&](Node& node) {
+            AABB box;
+            for (std::uint32_t i = 0; i < node.count; ++i) box = AABB::merge(box, bounds[order[node.leftFirst + i]]);
+            node.min = box.min;
+            node.max = box.max;
+        };
+        refit(nodes[0]);
+
+        std::vector<std::uint32_t> stack{ 0 };
+        while (!stack.empty()) {
+            std::uint32_t index = stack.back();
+            stack.pop_back();
+            Node node = nodes[index];
+            if (node.count <= 2) continue;
+
+            // centroid bounds pick the bin range
+            glm::vec3 cmin(FLT_MAX), cmax(-FLT_MAX);
+            for (std::uint32_t i = 0; i < node.count; ++i) {
+                cmin = glm::min(cmin, centroid[order[node.leftFirst + i]]);
+                cmax = glm::max(cmax, centroid[order[node.leftFirst + i]]);
+            }
+
+            // evaluate SAH cost for every bin boundary on every axis
+            float bestCost = FLT_MAX;
+            int bestAxis = -1;
+            float bestSplit = 0.0f;
+            for (int axis = 0; axis < 3; ++axis) {
+                float extent = cmax[axis] - cmin[axis];
+                if (extent <= 0.0f) continue;
+                AABB binBox[Bins];
+                std::uint32_t binCount[Bins] = {};
+                float scale = Bins / extent;
+                for (std::uint32_t i = 0; i < node.count; ++i) {
+                    std::uint32_t p = order[node.leftFirst + i];
+                    int b = std::min(Bins - 1, static_cast<int>((centroid[p][axis] - cmin[axis]) * scale));
+                    binCount[b]++;
+                    binBox[b] = AABB::merge(binBox[b], bounds[p]);
+                }
+                // sweep from both sides
+                float leftArea[Bins - 1], rightArea[Bins - 1];
+                std::uint32_t leftCount[Bins - 1], rightCount[Bins - 1];
+                AABB leftBox, rightBox;
+                std::uint32_t leftSum = 0, rightSum = 0;
+                for (int i = 0; i < Bins - 1; ++i) {
+                    leftSum += binCount[i];
+                    leftCount[i] = leftSum;
+                    leftBox = AABB::merge(leftBox, binBox[i]);
+                    leftArea[i] = leftSum ? leftBox.surfaceArea() : 0.0f;
+                    rightSum += binCount[Bins - 1 - i];
+                    rightCount[Bins - 2 - i] = rightSum;
+                    rightBox = AABB::merge(rightBox, binBox[Bins - 1 - i]);
+                    rightArea[Bins - 2 - i] = rightSum ? rightBox.surfaceArea() : 0.0f;
+                }
+                for (int i = 0; i < Bins - 1; ++i) {
+                    float cost = leftCount[i] * leftArea[i] + rightCount[i] * rightArea[i];
+                    if (cost < bestCost) {
+                        bestCost = cost;
+                        bestAxis = axis;
+                        bestSplit = cmin[axis] + extent * (i + 1) / Bins;
+                    }
+                }
+            }
+
+            // stop when splitting is not cheaper than intersecting everything
+            float leafCost = node.count * AABB(node.min, node.max).surfaceArea();
+            if (bestAxis < 0 || bestCost >= leafCost) continue;
+
+            // partition primitives in place
+            std::uint32_t i = node.leftFirst;
+            std::uint32_t j = i + node.count - 1;
+            while (i <= j && j != UINT32_MAX) {
+                if (centroid[order[i]][bestAxis] < bestSplit) ++i;
+                else std::swap(order[i], order[j--]);
+            }
+            std::uint32_t leftCount = i - node.leftFirst;
+            if (leftCount == 0 || leftCount == node.count) continue;
+
+            std::uint32_t left = static_cast<std::uint32_t>(nodes.size());
+            nodes.push_back(Node{ glm::vec3(0.0f), node.leftFirst, glm::vec3(0.0f), leftCount });
+            nodes.push_back(Node{ glm::vec3(0.0f), i, glm::vec3(0.0f), node.count - leftCount });
+            refit(nodes[left]);
+            refit(nodes[left + 1]);
+            nodes[index].leftFirst = left;
+            nodes[index].count = 0;
+            stack.push_back(left);
+            stack.push_back(left + 1);
+        }
+        nodes.shrink_to_fit();
+    }
+
+    // closest-hit traversal of one ray, leaf(first, count) tests primitives and
+    // lowers hit.t
+    template<typename LeafFn>
+    void traverse(const std::vector<Node>& nodes, const Ray& ray, const RayHit& hit, LeafFn&& leaf) {
+        if (nodes.empty()) return;
+        glm::vec3 invDir = inverseDirection(ray.direction);
+        std::uint32_t stack[MaxStack];
+        int top = 0;
+        stack[top++] = 0;
+        while (top > 0) {
+            const Node& node = nodes[stack[--top]];
+            if (intersectBox(node.min, node.max, ray.origin, invDir, hit.t) == FLT_MAX) continue;
+            if (node.isLeaf()) {
+                leaf(node.leftFirst, node.count);
+                continue;
+            }
+            // visit the nearer child first
+            const Node& a = nodes[node.leftFirst];
+            const Node& b = nodes[node.leftFirst + 1];
+            float da = intersectBox(a.min, a.max, ray.origin, invDir, hit.t);
+            float db = intersectBox(b.min, b.max, ray.origin, invDir, hit.t);
+            std::uint32_t first = node.leftFirst, second = node.leftFirst + 1;
+            if (da > db) { std::swap(da, db); std::swap(first, second); }
+            assert(top + 2 <= MaxStack);
+            if (db != FLT_MAX) stack[top++] = second;
+            if (da != FLT_MAX) stack[top++] = first;
+        }
+    }
+
+    // packet traversal: a node is visited once for all rays of the packet that
+    // still reach it, leaf(first, count, mask) tests the rays set in mask.
+    // At most MaxPacket rays, only those set in active are traced
+    template<typename LeafFn>
+    void traversePacket(const std::vector<Node>& nodes, const Ray* rays, const RayHit* hits, int count, LeafFn&& leaf,
+        std::uint64_t active = ~0ull) {
+        assert(count <= MaxPacket);
+        if (nodes.empty() || count <= 0) return;
+        count = std::min(count, MaxPacket);
+        glm::vec3 invDir[MaxPacket];
+        for (int r = 0; r < count; ++r) invDir[r] = inverseDirection(rays[r].direction);
+
+        struct Entry { std::uint32_t node; std::uint64_t mask; };
+        Entry stack[MaxStack];
+        int top = 0;
+        stack[top++] = { 0, (count == 64 ? ~0ull : ((1ull << count) - 1)) & active };
+        while (top > 0) {
+            Entry e = stack[--top];
+            const Node& node = nodes[e.node];
+            std::uint64_t mask = 0;
+            for (int r = 0; r < count; ++r) {
+                if (!(e.mask & (1ull << r))) continue;
+                if (intersectBox(node.min, node.max, rays[r].origin, invDir[r], hits[r].t) != FLT_MAX) mask |= 1ull << r;
+            }
+            if (!mask) continue;
+            if (node.isLeaf()) {
+                leaf(node.leftFirst, node.count, mask);
+                continue;
+            }
+            assert(top + 2 <= MaxStack);
+            stack[top++] = { node.leftFirst + 1, mask };
+            stack[top++] = { node.leftFirst, mask };
+        }
+    }
+}
+
+// Triangle BVH of one mesh, built from the CPU copy of its vertex and index data
+class MeshBVH {
+public:
+    MeshBVH(const std::vector<Vertex>& vertices, const std::vector<GLuint>& indices) {
+        std::size_t triCount = indices.size() / 3;
+        std::vector<AABB> bounds(triCount);
+        for (std::size_t i = 0; i < triCount; ++i) {
+            const glm::vec3& a = vertices[indices[3 * i + 0]].position;
+            const glm::vec3& b = vertices[indices[3 * i + 1]].position;
+            const glm::vec3& c = vertices[indices[3 * i + 2]].position;
+            bounds[i] = AABB(glm::min(a, glm::min(b, c)), glm::max(a, glm::max(b, c)));
+        }
+        std::vector<std::uint32_t> order;
+        BVH::build(bounds, nodes, order);
+
+        // store triangles in traversal order with precomputed edges
+        v0.resize(triCount);
+        e1.resize(triCount);
+        e2.resize(triCount);
+        triangleId.resize(triCount);
+        for (std::size_t i = 0; i < triCount; ++i) {
+            std::uint32_t t = order[i];
+            const glm::vec3& a = vertices[indices[3 * t + 0]].position;
+            v0[i] = a;
+            e1[i] = vertices[indices[3 * t + 1]].position - a;
+            e2[i] = vertices[indices[3 * t + 2]].position - a;
+            triangleId[i] = t;
+        }
+    }
+
+    AABB bounds() const {
+        return nodes.empty() ? AABB() : AABB(nodes[0].min, nodes[0].max);
+    }
+
+    std::size_t nodeCount() const { return nodes.size(); }
+
+    // closest hit closer than hit.t, returns true if hit was updated
+    bool intersect(const Ray& ray, RayHit& hit) const {
+        bool found = false;
+        BVH::traverse(nodes, ray, hit, [&](std::uint32_t first, std::uint32_t count) {
+            for (std::uint32_t i = first; i < first + count; ++i) found |= intersectTriangle(i, ray, hit);
+        });
+        return found;
+    }
+
+    // batched rays sharing one traversal (coherent rays: picking, spread shots, probes),
+    // at most BVH::MaxPacket; traces the rays set in active and returns those whose hit was updated
+    std::uint64_t intersect(const Ray* rays, RayHit* hits, int count, std::uint64_t active = ~0ull) const {
+        assert(count <= BVH::MaxPacket);
+        count = std::min(count, BVH::MaxPacket);
+        std::uint64_t updated = 0;
+        BVH::traversePacket(nodes, rays, hits, count, [&](std::uint32_t first, std::uint32_t n, std::uint64_t mask) {
+            for (int r = 0; r < count; ++r) {
+                if (!(mask & (1ull << r))) continue;
+                for (std::uint32_t i = first; i < first + n; ++i) {
+                    if (intersectTriangle(i, rays[r], hits[r])) updated |= 1ull << r;
+                }
+            }
+        }, active);
+        return updated;
+    }
+
+private:
+    std::vector<BVH::Node> nodes;
+    std::vector<glm::vec3> v0, e1, e2;
+    std::vector<std::uint32_t> triangleId;
+
+    // Moller-Trumbore, double sided
+    bool intersectTriangle(std::uint32_t i, const Ray& ray, RayHit& hit) const {
+        glm::vec3 p = glm::cross(ray.direction, e2[i]);
+        float det = glm::dot(e1[i], p);
+        if (std::abs(det) < 1e-12f) return false;
+        float invDet = 1.0f / det;
+        glm::vec3 s = ray.origin - v0[i];
+        float u = glm::dot(s, p) * invDet;
+        if (u < 0.0f || u > 1.0f) return false;
+        glm::vec3 q = glm::cross(s, e1[i]);
+        float v = glm::dot(ray.direction, q) * invDet;
+        if (v < 0.0f || u + v > 1.0f) return false;
+        float t = glm::dot(e2[i], q) * invDet;
+        if (t <= 0.0f || t >= hit.t) return false;
+        hit.t = t;
+        hit.u = u;
+        hit.v = v;
+        hit.primitive = triangleId[i];
+        return true;
+    }
+};
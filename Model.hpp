@@ -1,6 +1,8 @@
 #pragma once
 
+#include <cassert>
 #include <filesystem>
+#include <map>
 #include <string>
 #include <vector> 
 #include <glm/glm.hpp>
@@ -11,6 +13,9 @@
 #include "ShaderProgram.hpp"
 #include "OBJloader.hpp"
 #include "HeightMap.h"
+#include "Narrowphase.hpp"
+#include "SlotMap.hpp"
+#include "TransformSystem.hpp"
 
 
 class Model {
@@ -22,11 +27,15 @@ public:
     glm::vec3 scale{ 1.0f };
     ShaderProgram& shader;
     bool transparent{ false };
+    bool castsShadow{ true };   // independent of blending, textures with alpha still cast
     glm::vec3 AABBMin{ FLT_MAX };
     glm::vec3 AABBMax{ -FLT_MAX };
     glm::vec3 AABBTransformedMin{ 0.0f };
     glm::vec3 AABBTransformedMax{ 0.0f };
     bool transformed{ false };
+    // model space box used by the narrowphase, cached at load time
+    glm::vec3 localCenter{ 0.0f };
+    glm::vec3 localHalfExtents{ 0.0f };
 
     glm::mat4 modelMatrix{ 1.0f };  // model matrix for transformations
 
@@ -58,33 +67,26 @@ public:
 
     void updateAABBAndModelMatrix() {
         if (!transformed) return;
-        modelMatrix = glm::mat4(1.0f);
-        modelMatrix = glm::translate(modelMatrix, origin);
-        modelMatrix = glm::rotate(modelMatrix, orientation.x, glm::vec3(1, 0, 0));
-        modelMatrix = glm::rotate(modelMatrix, orientation.y, glm::vec3(0, 1, 0));
-        modelMatrix = glm::rotate(modelMatrix, orientation.z, glm::vec3(0, 0, 1));
-        modelMatrix = glm::scale(modelMatrix, scale);
-
-        glm::vec3 corners[8] = {
-            AABBMin,
-            glm::vec3(AABBMin.x, AABBMin.y, AABBMax.z),
-            glm::vec3(AABBMin.x, AABBMax.y, AABBMin.z),
-            glm::vec3(AABBMin.x, AABBMax.y, AABBMax.z),
-            glm::vec3(AABBMax.x, AABBMin.y, AABBMin.z),
-            glm::vec3(AABBMax.x, AABBMin.y, AABBMax.z),
-            glm::vec3(AABBMax.x, AABBMax.y, AABBMin.z),
-            AABBMax
-        };
-
-        glm::vec3 newMin(FLT_MAX), newMax(-FLT_MAX);
-        for (auto& corner : corners) {
-            glm::vec3 transformed = glm::vec3(modelMatrix * glm::vec4(corner, 1.0));
-            newMin = glm::min(newMin, transformed);
-            newMax = glm::max(newMax, transformed);
-        }
-        AABBTransformedMax = newMax;
-        AABBTransformedMin = newMin;
+        modelMatrix = TransformSystem::composeLocal(origin, orientation, scale);
+
+        // transformed box from center and extents instead of 8 corners
+        glm::vec3 center = glm::vec3(modelMatrix * glm::vec4(localCenter, 1.0f));
+        glm::vec3 extent = glm::abs(glm::vec3(modelMatrix[0])) * localHalfExtents.x
+            + glm::abs(glm::vec3(modelMatrix[1])) * localHalfExtents.y
+            + glm::abs(glm::vec3(modelMatrix[2])) * localHalfExtents.z;
+        AABBTransformedMin = center - extent;
+        AABBTransformedMax = center + extent;
+
+        transformed = false;
+    }
 
+    // results of a TransformSystem node driving this model; origin follows the
+    // world position so code reading it (e.g. depth sorting) sees where the model is
+    void setWorldTransform(const glm::mat4& matrix, const glm::vec3& worldMin, const glm::vec3& worldMax) {
+        modelMatrix = matrix;
+        origin = glm::vec3(matrix[3]);
+        AABBTransformedMin = worldMin;
+        AABBTransformedMax = worldMax;
         transformed = false;
     }
 
@@ -102,6 +104,73 @@ public:
         return getAABBMax().y - getAABBMin().y;
     }
 
+    // build triangle BVHs of all meshes and a small tree over their bounds
+    void buildBVH() {
+        std::vector<AABB> bounds;
+        std::vector<std::uint32_t> ids;
+        for (std::uint32_t i = 0; i < meshes.size(); ++i) {
+            meshes[i].buildBVH();
+            if (!meshes[i].bvh) continue;
+            bounds.push_back(meshes[i].bvh->bounds());
+            ids.push_back(i);
+        }
+        BVH::build(bounds, meshTree, meshOrder);
+        for (auto& id : meshOrder) id = ids[id];
+    }
+
+    // closest hit of a world space ray closer than hit.t (needs buildBVH)
+    bool raycast(const Ray& ray, RayHit& hit) {
+        if (meshTree.empty()) return false;
+        updateAABBAndModelMatrix();
+        if (BVH::intersectBox(AABBTransformedMin, AABBTransformedMax, ray.origin,
+            BVH::inverseDirection(ray.direction), hit.t) == FLT_MAX) return false;
+
+        Ray local = toModelSpace(ray, glm::inverse(modelMatrix));
+        bool found = false;
+        BVH::traverse(meshTree, local, hit, [&](std::uint32_t first, std::uint32_t count) {
+            for (std::uint32_t i = first; i < first + count; ++i) {
+                std::uint32_t m = meshOrder[i];
+                if (meshes[m].bvh->intersect(local, hit)) {
+                    hit.mesh = m;
+                    found = true;
+                }
+            }
+        });
+        return found;
+    }
+
+    // packet version of at most BVH::MaxPacket rays, returns a bit mask of the
+    // rays whose hit was updated; meshes are traced with triangle level packets
+    std::uint64_t raycast(const Ray* rays, RayHit* hits, int count) {
+        assert(count <= BVH::MaxPacket);
+        count = std::min(count, BVH::MaxPacket);
+        if (meshTree.empty() || count <= 0) return 0;
+        updateAABBAndModelMatrix();
+
+        glm::mat4 inv = glm::inverse(modelMatrix);
+        Ray local[BVH::MaxPacket];
+        for (int r = 0; r < count; ++r) local[r] = toModelSpace(rays[r], inv);
+
+        std::uint64_t updated = 0;
+        BVH::traversePacket(meshTree, local, hits, count, [&](std::uint32_t first, std::uint32_t n, std::uint64_t mask) {
+            for (std::uint32_t i = first; i < first + n; ++i) {
+                std::uint32_t m = meshOrder[i];
+                std::uint64_t hit = meshes[m].bvh->intersect(local, hits, count, mask);
+                for (int r = 0; r < count; ++r) {
+                    if (hit & (1ull << r)) hits[r].mesh = m;
+                }
+                updated |= hit;
+            }
+        });
+        return updated;
+    }
+
+    // tight oriented box of the model in world space
+    OBB getOBB() {
+        updateAABBAndModelMatrix();
+        return Narrowphase::makeOBB(modelMatrix, localCenter, localHalfExtents);
+    }
+
     void draw(const glm::mat4& projection, const glm::mat4& view, const glm::vec3& viewPos) {
         updateAABBAndModelMatrix();
 
@@ -113,7 +182,41 @@ public:
 private:
 #include <tuple>
 
+    // ray query tree over mesh bounds, meshOrder maps leaf slots to mesh indices
+    std::vector<BVH::Node> meshTree;
+    std::vector<std::uint32_t> meshOrder;
+
+    // the direction is not renormalized, so t stays the same as in world space
+    static Ray toModelSpace(const Ray& ray, const glm::mat4& inverseModel) {
+        Ray local;
+        local.origin = glm::vec3(inverseModel * glm::vec4(ray.origin, 1.0f));
+        local.direction = glm::vec3(inverseModel * glm::vec4(ray.direction, 0.0f));
+        return local;
+    }
+
+    // geometry of every OBJ file loaded so far (per shader); models of the same
+    // file copy the meshes and share their GL buffers, which lets them be drawn instanced
+    struct LoadedOBJ {
+        std::vector<Mesh> meshes;
+        glm::vec3 min, max;
+    };
+    static inline std::map<std::pair<std::string, const ShaderProgram*>, LoadedOBJ> objCache;
+
     void loadModel(const std::filesystem::path& path) {
+        auto key = std::make_pair(std::filesystem::absolute(path).lexically_normal().string(), &shader);
+        auto cached = objCache.find(key);
+        if (cached != objCache.end()) {
+            for (const Mesh& mesh : cached->second.meshes) meshes.push_back(mesh);
+            AABBMin = cached->second.min;
+            AABBMax = cached->second.max;
+            AABBTransformedMax = AABBMax;
+            AABBTransformedMin = AABBMin;
+            localCenter = (AABBMin + AABBMax) * 0.5f;
+            localHalfExtents = (AABBMax - AABBMin) * 0.5f;
+            name = path.stem().string();
+            return;
+        }
+
         // load mesh (all meshes) of the model, (in the future: load material of each mesh, load textures...)
         // call LoadOBJFile, LoadMTLFile (if exist), process data, create mesh and set its properties
         //    notice: you can load multiple meshes and place them to proper positions, 
@@ -144,8 +247,11 @@ private:
         }
         AABBTransformedMax = AABBMax;
         AABBTransformedMin = AABBMin;
+        localCenter = (AABBMin + AABBMax) * 0.5f;
+        localHalfExtents = (AABBMax - AABBMin) * 0.5f;
         // create Mesh and store it
         meshes.emplace_back(GL_TRIANGLES, shader, vertices, indices, origin, orientation);
+        objCache.emplace(key, LoadedOBJ{ meshes, AABBMin, AABBMax });
 
         // set model name based on the filename stem
         name = path.stem().string();
@@ -188,6 +294,19 @@ public:
         pos.y = centered * height_scale + modelHeight;
     }
 
+    // terrain height at world x, z (0 outside the map)
+    float getHeightAt(float x, float z) {
+        glm::vec3 pos(x, 0.0f, z);
+        getHeightOnMap(pos);
+        return pos.y;
+    }
+
+    // upper bound of getHeightAt(), useful to skip terrain tests early
+    float getMaxHeight() const { return height_scale; }
+
+    // world size of one heightmap pixel
+    float getCellSize() const { return mapScaleXZ; }
+
 private:
     int mesh_step_size = 30; // Controls mesh triangle density/detail
     float height_scale = 0.5f; // Controls height exaggeration
@@ -205,8 +324,19 @@ private:
             height_scale, minMapVal, maxMapVal, mapScaleXZ, shader);
         for (auto& mesh : terrainMeshes) {
             meshes.push_back(mesh);
+            for (auto& v : mesh.vertices) {
+                AABBMin = glm::min(AABBMin, v.position);
+                AABBMax = glm::max(AABBMax, v.position);
+            }
         }
+        AABBTransformedMin = AABBMin;
+        AABBTransformedMax = AABBMax;
+        localCenter = (AABBMin + AABBMax) * 0.5f;
+        localHalfExtents = (AABBMax - AABBMin) * 0.5f;
         name = "Terrain";
         std::cout << "Loaded heightmap: resources/textures/heights.png" << std::endl;
     }
-};
\ No newline at end of file
+};
+
+// stable reference to a model stored in a SlotMap<Model>
+using ModelHandle = SlotMap<Model>::Handle;
\ No newline at end of file
@@ -0,0 +1,102 @@
+#pragma once
+#include <glm/glm.hpp>
+#include <cfloat>
+#include <cmath>
+
+// Oriented bounding box. Every member is padded to a vec4 so each one maps
+// onto a single SIMD register and OBBs can be stored back to back.
+struct alignas(16) OBB {
+    glm::vec4 center{ 0.0f };        // world space, w unused
+    glm::vec4 axis[3]{ glm::vec4(1, 0, 0, 0), glm::vec4(0, 1, 0, 0), glm::vec4(0, 0, 1, 0) }; // unit axes
+    glm::vec4 halfExtents{ 0.0f };   // along each axis, w unused
+};
+
+// Contact of two overlapping boxes: normal is unit length and points from A to B
+struct Contact {
+    glm::vec3 normal{ 0.0f, 1.0f, 0.0f };
+    float depth = 0.0f;
+};
+
+namespace Narrowphase {
+
+    // box of a model space AABB (center, half extents) placed by a model matrix
+    inline OBB makeOBB(const glm::mat4& model, const glm::vec3& localCenter, const glm::vec3& localHalfExtents) {
+        OBB box;
+        box.center = model * glm::vec4(localCenter, 1.0f);
+        box.center.w = 0.0f;
+        for (int i = 0; i < 3; ++i) {
+            glm::vec3 column(model[i]);
+            float len = glm::length(column);
+            box.axis[i] = glm::vec4(len > 0.0f ? column / len : glm::vec3(0.0f), 0.0f);
+            box.halfExtents[i] = localHalfExtents[i] * len;
+        }
+        return box;
+    }
+
+    // separating axis test of two OBBs (15 axes), fills the axis of least
+    // penetration on overlap
+    inline bool intersect(const OBB& a, const OBB& b, Contact& contact) {
+        constexpr float eps = 1e-6f;
+
+        float R[3][3], AbsR[3][3];
+        for (int i = 0; i < 3; ++i) {
+            for (int j = 0; j < 3; ++j) {
+                R[i][j] = glm::dot(a.axis[i], b.axis[j]);
+                // epsilon guards edge-edge axes of (near) parallel edges
+                AbsR[i][j] = std::abs(R[i][j]) + eps;
+            }
+        }
+
+        // translation in A's frame
+        glm::vec4 d = b.center - a.center;
+        float t[3] = { glm::dot(d, a.axis[0]), glm::dot(d, a.axis[1]), glm::dot(d, a.axis[2]) };
+        const glm::vec4& ea = a.halfExtents;
+        const glm::vec4& eb = b.halfExtents;
+
+        float bestDepth = FLT_MAX;
+        glm::vec3 bestAxis(0.0f);
+
+        // keeps the axis with the smallest overlap, axisLength normalizes cross product axes
+        auto test = [&](float dist, float ra, float rb, const glm::vec3& axis, float axisLength) {
+            float overlap = ra + rb - std::abs(dist);
+            if (overlap < 0.0f) return false;
+            if (axisLength < eps) return true; // degenerate cross product, skip
+            overlap /= axisLength;
+            if (overlap < bestDepth) {
+                bestDepth = overlap;
+                bestAxis = (dist < 0.0f ? -axis : axis) / axisLength;
+            }
+            return true;
+        };
+
+        // face axes of A
+        for (int i = 0; i < 3; ++i) {
+            float rb = eb[0] * AbsR[i][0] + eb[1] * AbsR[i][1] + eb[2] * AbsR[i][2];
+            if (!test(t[i], ea[i], rb, glm::vec3(a.axis[i]), 1.0f)) return false;
+        }
+
+        // face axes of B
+        for (int j = 0; j < 3; ++j) {
+            float ra = ea[0] * AbsR[0][j] + ea[1] * AbsR[1][j] + ea[2] * AbsR[2][j];
+            float dist = t[0] * R[0][j] + t[1] * R[1][j] + t[2] * R[2][j];
+            if (!test(dist, ra, eb[j], glm::vec3(b.axis[j]), 1.0f)) return false;
+        }
+
+        // edge-edge axes A_i x B_j
+        for (int i = 0; i < 3; ++i) {
+            int i1 = (i + 1) % 3, i2 = (i + 2) % 3;
+            for (int j = 0; j < 3; ++j) {
+                int j1 = (j + 1) % 3, j2 = (j + 2) % 3;
+                float ra = ea[i1] * AbsR[i2][j] + ea[i2] * AbsR[i1][j];
+                float rb = eb[j1] * AbsR[i][j2] + eb[j2] * AbsR[i][j1];
+                float dist = t[i2] * R[i1][j] - t[i1] * R[i2][j];
+                glm::vec3 axis = glm::cross(glm::vec3(a.axis[i]), glm::vec3(b.axis[j]));
+                if (!test(dist, ra, rb, axis, glm::length(axis))) return false;
+            }
+        }
+
+        contact.normal = bestAxis;
+        contact.depth = bestDepth;
+        return true;
+    }
+}
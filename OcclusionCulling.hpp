@@ -0,0 +1,132 @@
+#pragma once
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <algorithm>
+#include <cstdint>
+
+#include "ShaderProgram.hpp"
+
+// Hierarchical depth (Hi-Z) occlusion culling on the GPU. The scene depth is
+// copied into level 0 of an R32F mip chain and every level above keeps the
+// farthest depth of the texels below it. occlusion_cull.comp tests instance
+// boxes against the pyramid and writes the surviving instances and their
+// counts straight into the indirect draw commands, nothing is read back.
+// InstancedRenderer drives the two phases; this class owns the pyramid.
+class OcclusionCuller {
+public:
+    // storage buffer bindings of occlusion_cull.comp, besides the visible
+    // instances at InstancedRenderer::InstanceBinding
+    static constexpr GLuint InputBinding = 13;
+    static constexpr GLuint CommandIdBinding = 14;
+    static constexpr GLuint BoundsBinding = 15;
+    static constexpr GLuint FirstCommandsBinding = 16;
+    static constexpr GLuint SecondCommandsBinding = 17;
+    static constexpr GLuint DrawnFirstBinding = 18;
+
+    OcclusionCuller() = default;
+    OcclusionCuller(const OcclusionCuller&) = delete;
+    OcclusionCuller& operator=(const OcclusionCuller&) = delete;
+    ~OcclusionCuller() { clear(); }
+
+    // needs a GL context with compute shaders
+    void init() {
+        reduceProgram = ShaderProgram("resources/shaders/hiz_reduce.comp");
+        cullProgram = ShaderProgram("resources/shaders/occlusion_cull.comp");
+    }
+
+    bool ready() const { return cullProgram.getID() != 0; }
+
+    // framebuffer size, the pyramid is recreated on the next build
+    void setViewport(int w, int h) {
+        if (w == width && h == height) return;
+        width = std::max(w, 1);
+        height = std::max(h, 1);
+        history = false;
+    }
+
+    // framebuffer the scene depth is read from; its depth must be 32F (the
+    // scene target or the G-buffer), a depth blit between formats is an error
+    void setDepthSource(GLuint framebuffer) { depthSource = framebuffer; }
+
+    // phase 1 or 2 over count instances, buffers are bound by the caller
+    void cull(int phase, std::uint32_t count, const glm::mat4& viewProjection) {
+        cullProgram.activate();
+        cullProgram.setUniform("phase", phase);
+        cullProgram.setUniform("history", history && pyramid ? 1 : 0);
+        cullProgram.setUniform("viewProjection", phase == 1 ? previousViewProjection : viewProjection);
+        cullProgram.setUniform("pyramidLevels", levels);
+        cullProgram.setUniform("pyramid", 0);
+        glProgramUniform1ui(cullProgram.getID(), cullProgram.getUniformLocation("instanceCount"), count);
+        glProgramUniform2i(cullProgram.getID(), cullProgram.getUniformLocation("pyramidSize"), pyramidWidth, pyramidHeight);
+        glBindTextureUnit(0, pyramid);
+        glDispatchCompute((count + 63) / 64, 1, 1);
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_COMMAND_BARRIER_BIT);
+    }
+
+    // pyramid from the current depth of the source framebuffer
+    void buildPyramid() {
+        if (!depthSource) return;
+        if (!pyramid || pyramidWidth != width || pyramidHeight != height) create();
+        glBlitNamedFramebuffer(depthSource, depthFBO, 0, 0, width, height, 0, 0, width, height, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+
+        reduceProgram.activate();
+        reduceProgram.setUniform("sceneDepth", 0);
+        glBindTextureUnit(0, depthCopy);
+        for (int level = 0; level < levels; ++level) {
+            reduceProgram.setUniform("fromDepth", level == 0 ? 1 : 0);
+            if (level > 0) glBindImageTexture(0, pyramid, level - 1, GL_FALSE, 0, GL_READ_ONLY, GL_R32F);
+            glBindImageTexture(1, pyramid, level, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+            int w = std::max(width >> level, 1), h = std::max(height >> level, 1);
+            glDispatchCompute((w + 7) / 8, (h + 7) / 8, 1);
+            glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT | GL_TEXTURE_FETCH_BARRIER_BIT);
+        }
+    }
+
+    // the pyramid now holds this frame's depth, phase 1 of the next frame uses it
+    void endFrame(const glm::mat4& viewProjection) {
+        previousViewProjection = viewProjection;
+        history = pyramid != 0;
+    }
+
+    void clear() {
+        destroyPyramid();
+        reduceProgram.clear();
+        cullProgram.clear();
+        history = false;
+    }
+
+private:
+    ShaderProgram reduceProgram, cullProgram;
+    GLuint pyramid = 0, depthCopy = 0, depthFBO = 0;
+    GLuint depthSource = 0;
+    int width = 1, height = 1, levels = 1;
+    int pyramidWidth = 0, pyramidHeight = 0;
+    bool history = false;
+    glm::mat4 previousViewProjection{ 1.0f };
+
+    void create() {
+        destroyPyramid();
+        levels = 1;
+        while ((std::max(width, height) >> levels) > 0) ++levels;
+        glCreateTextures(GL_TEXTURE_2D, 1, &pyramid);
+        glTextureStorage2D(pyramid, levels, GL_R32F, width, height);
+        glTextureParameteri(pyramid, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+        glTextureParameteri(pyramid, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+        // the source may be multisampled, its depth is blitted (resolved) here first
+        glCreateTextures(GL_TEXTURE_2D, 1, &depthCopy);
+        glTextureStorage2D(depthCopy, 1, GL_DEPTH_COMPONENT32F, width, height);
+        glCreateFramebuffers(1, &depthFBO);
+        glNamedFramebufferTexture(depthFBO, GL_DEPTH_ATTACHMENT, depthCopy, 0);
+        pyramidWidth = width;
+        pyramidHeight = height;
+    }
+
+    void destroyPyramid() {
+        if (pyramid) glDeleteTextures(1, &pyramid);
+        if (depthCopy) glDeleteTextures(1, &depthCopy);
+        if (depthFBO) glDeleteFramebuffers(1, &depthFBO);
+        pyramid = depthCopy = depthFBO = 0;
+        pyramidWidth = pyramidHeight = 0;
+    }
+};
@@ -1,93 +1,204 @@
 #pragma once
+#include <GL/glew.h>
 #include <glm/glm.hpp>
 #include <glm/gtc/random.hpp>
+#include <algorithm>
+#include <cstdlib>
 #include <vector>
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
 #include "ShaderProgram.hpp"
 
-namespace Particles {
-    struct Particle {
-        glm::vec3 position, velocity;
-        float life = 0.7f;
-        bool active = false;
+// CPU particle engine, used when compute shaders are not available and for
+// headless runs. State is kept as separate arrays (structure of arrays) so
+// the integration is a straight SIMD loop. Every emitter owns a fixed range
+// of the arrays; its live particles are packed at the front of the range,
+// so spawning appends and killing swaps the last live particle into the
+// hole. Both are O(1) and an update only touches live particles.
+class ParticleSystem {
+public:
+    using Emitter = int;
+
+    struct EmitterSettings {
+        std::size_t capacity = 1024;
+        glm::vec3 acceleration{ 0.0f };   // e.g. gravity
+        float speed = 2.0f;               // initial speed, random direction
+        float life = 0.5f;                // base lifetime in seconds
+        float lifeJitter = 1.0f;          // random extra lifetime
     };
 
-	constexpr int MAX_PARTICLES = 1000;                // Maximum number of particles in the pool
-	inline std::vector<Particle> pool(MAX_PARTICLES);  // Particle pool
-
-	// Update all active particles
-    inline void update(float dt) {
-        for (auto& p : pool) {
-            if (!p.active) continue;
-            p.position += p.velocity * dt;
-            p.life -= dt;
-            if (p.life <= 0.0f) p.active = false;
-        }
+    ParticleSystem() = default;
+    ParticleSystem(const ParticleSystem&) = delete;
+    ParticleSystem& operator=(const ParticleSystem&) = delete;
+    ~ParticleSystem() { clear(); }
+
+    // reserves capacity slots (rounded up to the SIMD width) for a new emitter
+    Emitter addEmitter(const EmitterSettings& settings) {
+        Range r;
+        r.settings = settings;
+        r.base = px.size();
+        r.capacity = (settings.capacity + Lanes - 1) / Lanes * Lanes;
+        std::size_t size = r.base + r.capacity;
+        for (auto* a : { &px, &py, &pz, &vx, &vy, &vz, &life }) a->resize(size, 0.0f);
+        emitters.push_back(r);
+        return static_cast<Emitter>(emitters.size() - 1);
     }
 
-	// Spawn new particles at a given origin
-    inline void spawn(const glm::vec3& origin, int count = 10) {
-        int spawned = 0;
-        for (auto& p : pool) {
-            if (!p.active) {
-                p.position = origin;
-                p.velocity = glm::sphericalRand(2.0f);
-                p.life = 0.5f + float(rand()) / RAND_MAX;
-                p.active = true;
-                if (++spawned >= count) break;
-            }
+    // particles over the emitter capacity are dropped
+    void spawn(Emitter e, const glm::vec3& origin, int count) {
+        Range& r = emitters[e];
+        const EmitterSettings& s = r.settings;
+        int n = std::min<int>(count, static_cast<int>(r.capacity - r.alive));
+        for (int k = 0; k < n; ++k) {
+            std::size_t i = r.base + r.alive++;
+            glm::vec3 v = glm::sphericalRand(s.speed);
+            px[i] = origin.x; py[i] = origin.y; pz[i] = origin.z;
+            vx[i] = v.x; vy[i] = v.y; vz[i] = v.z;
+            life[i] = s.life + s.lifeJitter * float(rand()) / RAND_MAX;
         }
     }
 
-    // Draw all active particles as GL_POINTS
-    // shader must have a vec4 uniform "color" and a mat4 uniform "uMVP"
-    inline void drawParticles(const glm::mat4& projection, const glm::mat4& view, ShaderProgram& shader) {
-        std::vector<glm::vec3> points;
-
-        for (const auto& p : pool) {
-            if (p.active) {
-                points.push_back(p.position);
-                points.push_back(p.position + p.velocity * 0.1f);
+    void update(float dt) {
+        for (Range& r : emitters) {
+            if (r.alive == 0) continue;
+            integrate(r, dt);
+            // swap the last live particle into every dead slot
+            std::size_t i = r.base, end = r.base + r.alive;
+            while (i < end) {
+                if (life[i] > 0.0f) { ++i; continue; }
+                --end;
+                px[i] = px[end]; py[i] = py[end]; pz[i] = pz[end];
+                vx[i] = vx[end]; vy[i] = vy[end]; vz[i] = vz[end];
+                life[i] = life[end];
             }
+            r.alive = end - r.base;
         }
+    }
 
-        if (points.empty()) return;
+    // kill every particle, emitters are kept
+    void reset() {
+        for (Range& r : emitters) r.alive = 0;
+    }
 
-        // Create VAO and VBO using DSA
-        GLuint VAO = 0, VBO = 0;
-        glCreateVertexArrays(1, &VAO);
-        glCreateBuffers(1, &VBO);
+    std::size_t aliveCount() const {
+        std::size_t n = 0;
+        for (const Range& r : emitters) n += r.alive;
+        return n;
+    }
+    std::size_t aliveCount(Emitter e) const { return emitters[e].alive; }
+    std::size_t capacity() const { return px.size(); }
 
-        glNamedBufferData(VBO, points.size() * sizeof(glm::vec3), points.data(), GL_STATIC_DRAW);
+    glm::vec3 getPosition(std::size_t i) const { return glm::vec3(px[i], py[i], pz[i]); }
+    glm::vec3 getVelocity(std::size_t i) const { return glm::vec3(vx[i], vy[i], vz[i]); }
 
-        // Attach VBO to VAO, layout location 0
-        glVertexArrayVertexBuffer(VAO, 0, VBO, 0, sizeof(glm::vec3));
-        glEnableVertexArrayAttrib(VAO, 0);
-        glVertexArrayAttribFormat(VAO, 0, 3, GL_FLOAT, GL_FALSE, 0);
-        glVertexArrayAttribBinding(VAO, 0, 0); // bind attribute index 0 to binding index 0
+    // live particles as streaks along the velocity, one draw call
+    // shader must have a vec4 uniform "color" and a mat4 uniform "uMVP"
+    void draw(const glm::mat4& projection, const glm::mat4& view, ShaderProgram& shader) {
+        lines.clear();
+        for (const Range& r : emitters) {
+            for (std::size_t i = r.base; i < r.base + r.alive; ++i) {
+                glm::vec3 p(px[i], py[i], pz[i]);
+                lines.push_back(p);
+                lines.push_back(p + glm::vec3(vx[i], vy[i], vz[i]) * 0.1f);
+            }
+        }
+        if (lines.empty()) return;
+
+        // one buffer kept across frames, orphaned on every upload
+        if (!VAO) {
+            glCreateVertexArrays(1, &VAO);
+            glCreateBuffers(1, &VBO);
+            glVertexArrayVertexBuffer(VAO, 0, VBO, 0, sizeof(glm::vec3));
+            glEnableVertexArrayAttrib(VAO, 0);
+            glVertexArrayAttribFormat(VAO, 0, 3, GL_FLOAT, GL_FALSE, 0);
+            glVertexArrayAttribBinding(VAO, 0, 0);
+        }
+        glNamedBufferData(VBO, lines.size() * sizeof(glm::vec3), lines.data(), GL_STREAM_DRAW);
 
-        // Activate shader and set uniforms via DSA
         shader.activate();
-        GLuint programID = shader.getID();
-
-        glm::mat4 model = glm::mat4(1.0f);
-        glm::mat4 mvp = projection * view * model;
-
-        GLint locMVP = glGetUniformLocation(programID, "uMVP");
-        GLint locColor = glGetUniformLocation(programID, "color");
+        shader.setUniform("uMVP", projection * view);
+        shader.setUniform("color", glm::vec4(1.0f, 0.5f, 0.0f, 1.0f));
 
-        glProgramUniformMatrix4fv(programID, locMVP, 1, GL_FALSE, &mvp[0][0]);
-        glProgramUniform4f(programID, locColor, 1.0f, 0.5f, 0.0f, 1.0f); 
-
-        glEnable(GL_PROGRAM_POINT_SIZE);
         glLineWidth(3.5f);
         glBindVertexArray(VAO);
-        glDrawArrays(GL_LINES, 0, static_cast<GLsizei>(points.size()));
+        glDrawArrays(GL_LINES, 0, static_cast<GLsizei>(lines.size()));
         glBindVertexArray(0);
+    }
 
-        // Cleanup
-        glDeleteBuffers(1, &VBO);
-        glDeleteVertexArrays(1, &VAO);
+    // GL resources only
+    void clear() {
+        if (VBO) glDeleteBuffers(1, &VBO);
+        if (VAO) glDeleteVertexArrays(1, &VAO);
+        VBO = VAO = 0;
     }
 
+private:
+#if defined(__AVX__)
+    static constexpr std::size_t Lanes = 8;
+#else
+    static constexpr std::size_t Lanes = 4;
+#endif
+
+    struct Range {
+        EmitterSettings settings;
+        std::size_t base = 0;       // first slot in the arrays
+        std::size_t capacity = 0;   // multiple of Lanes
+        std::size_t alive = 0;      // live particles are [base, base + alive)
+    };
 
-}
\ No newline at end of file
+    std::vector<Range> emitters;
+    std::vector<float> px, py, pz, vx, vy, vz, life;
+    std::vector<glm::vec3> lines;
+    GLuint VAO = 0, VBO = 0;
+
+    // v += a * dt, p += v * dt, life -= dt over the live range rounded up to
+    // the SIMD width; the padding slots stay inside the emitter range
+    void integrate(Range& r, float dt) {
+        std::size_t first = r.base;
+        std::size_t last = r.base + (r.alive + Lanes - 1) / Lanes * Lanes;
+        glm::vec3 dv = r.settings.acceleration * dt;
+        float* x = px.data(); float* y = py.data(); float* z = pz.data();
+        float* u = vx.data(); float* v = vy.data(); float* w = vz.data();
+        float* l = life.data();
+#if defined(__AVX__)
+        __m256 t = _mm256_set1_ps(dt);
+        __m256 ax = _mm256_set1_ps(dv.x), ay = _mm256_set1_ps(dv.y), az = _mm256_set1_ps(dv.z);
+        for (std::size_t i = first; i < last; i += 8) {
+            __m256 nu = _mm256_add_ps(_mm256_loadu_ps(u + i), ax);
+            __m256 nv = _mm256_add_ps(_mm256_loadu_ps(v + i), ay);
+            __m256 nw = _mm256_add_ps(_mm256_loadu_ps(w + i), az);
+            _mm256_storeu_ps(u + i, nu);
+            _mm256_storeu_ps(v + i, nv);
+            _mm256_storeu_ps(w + i, nw);
+            _mm256_storeu_ps(x + i, _mm256_add_ps(_mm256_loadu_ps(x + i), _mm256_mul_ps(nu, t)));
+            _mm256_storeu_ps(y + i, _mm256_add_ps(_mm256_loadu_ps(y + i), _mm256_mul_ps(nv, t)));
+            _mm256_storeu_ps(z + i, _mm256_add_ps(_mm256_loadu_ps(z + i), _mm256_mul_ps(nw, t)));
+            _mm256_storeu_ps(l + i, _mm256_sub_ps(_mm256_loadu_ps(l + i), t));
+        }
+#elif defined(__SSE2__) || defined(_M_X64)
+        __m128 t = _mm_set1_ps(dt);
+        __m128 ax = _mm_set1_ps(dv.x), ay = _mm_set1_ps(dv.y), az = _mm_set1_ps(dv.z);
+        for (std::size_t i = first; i < last; i += 4) {
+            __m128 nu = _mm_add_ps(_mm_loadu_ps(u + i), ax);
+            __m128 nv = _mm_add_ps(_mm_loadu_ps(v + i), ay);
+            __m128 nw = _mm_add_ps(_mm_loadu_ps(w + i), az);
+            _mm_storeu_ps(u + i, nu);
+            _mm_storeu_ps(v + i, nv);
+            _mm_storeu_ps(w + i, nw);
+            _mm_storeu_ps(x + i, _mm_add_ps(_mm_loadu_ps(x + i), _mm_mul_ps(nu, t)));
+            _mm_storeu_ps(y + i, _mm_add_ps(_mm_loadu_ps(y + i), _mm_mul_ps(nv, t)));
+            _mm_storeu_ps(z + i, _mm_add_ps(_mm_loadu_ps(z + i), _mm_mul_ps(nw, t)));
+            _mm_storeu_ps(l + i, _mm_sub_ps(_mm_loadu_ps(l + i), t));
+        }
+#else
+        for (std::size_t i = first; i < last; ++i) {
+            u[i] += dv.x; v[i] += dv.y; w[i] += dv.z;
+            x[i] += u[i] * dt; y[i] += v[i] * dt; z[i] += w[i] * dt;
+            l[i] -= dt;
+        }
+#endif
+    }
+};
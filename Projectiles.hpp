@@ -0,0 +1,238 @@
+#pragma once
+#include <glm/glm.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#include "AABBTree.hpp"
+#include "Model.hpp"
+
+// Result of a projectile hitting something during ProjectileSystem::update
+struct ProjectileHit {
+    glm::vec3 position;      // contact point (projectile center)
+    glm::vec3 normal;        // surface normal at the contact
+    std::uint64_t target;    // broadphase user data of the hit object, 0 for terrain
+    bool terrain;
+};
+
+// Fixed capacity projectile pool with continuous collision detection.
+// Live projectiles are packed at the front of the arrays: spawning appends,
+// killing moves the last live projectile into the freed slot. No allocation
+// happens after construction. A round may hold a light slot for its whole
+// life; slots move with the round when it is packed and the lowest free one
+// is handed out first, so the used slots stay dense.
+class ProjectileSystem {
+public:
+    static constexpr std::uint32_t NoLight = UINT32_MAX;
+
+    float radius = 0.05f;        // collision radius of a round
+    float lifetime = 2.0f;       // seconds before a round is recycled
+    float gravity = 0.0f;
+    float impulse = 0.5f;        // velocity change given to hit objects
+    std::uint32_t collisionMask = CollisionLayer::Bot | CollisionLayer::Static;
+
+    explicit ProjectileSystem(std::size_t capacity = 4096) { setCapacity(capacity); }
+
+    // drops all live projectiles
+    void setCapacity(std::size_t capacity) {
+        position.assign(capacity, glm::vec3(0.0f));
+        previous.assign(capacity, glm::vec3(0.0f));
+        velocity.assign(capacity, glm::vec3(0.0f));
+        age.assign(capacity, 0.0f);
+        light.assign(capacity, NoLight);
+        alive = 0;
+        // min-heap of free light slots, ascending order is already one
+        freeLights.clear();
+        for (std::size_t s = 0; s < std::min(lightSlots, capacity); ++s) freeLights.push_back(static_cast<std::uint32_t>(s));
+    }
+
+    // number of light slots shared by the rounds, drops all live projectiles
+    void setLightSlots(std::size_t count) {
+        lightSlots = count;
+        setCapacity(capacity());
+    }
+
+    std::size_t capacity() const { return position.size(); }
+    std::size_t size() const { return alive; }
+
+    // returns false when the pool is exhausted
+    bool spawn(const glm::vec3& origin, const glm::vec3& vel) {
+        if (alive == capacity()) return false;
+        position[alive] = origin;
+        previous[alive] = origin;
+        velocity[alive] = vel;
+        age[alive] = 0.0f;
+        light[alive] = NoLight;
+        if (!freeLights.empty()) {
+            std::pop_heap(freeLights.begin(), freeLights.end(), std::greater<>());
+            light[alive] = freeLights.back();
+            freeLights.pop_back();
+        }
+        ++alive;
+        return true;
+    }
+
+    // advance all rounds by dt, sweeping each one against the broadphase and terrain
+    void update(float dt, const DynamicAABBTree& broadphase, Terrain* terrain, std::vector<ProjectileHit>& hits) {
+        hits.clear();
+        std::size_t i = 0;
+        while (i < alive) {
+            age[i] += dt;
+            velocity[i].y += gravity * dt;
+
+            glm::vec3 start = position[i];
+            glm::vec3 delta = velocity[i] * dt;
+            previous[i] = start;
+
+            float tHit = 1.0f;
+            ProjectileHit hit{};
+            bool collided = sweepBroadphase(start, delta, broadphase, tHit, hit);
+            if (terrain) collided |= sweepTerrain(start, delta, *terrain, tHit, hit);
+
+            if (collided) {
+                hit.position = start + delta * tHit;
+                hits.push_back(hit);
+                kill(i);
+                continue; // slot i now holds a round that has not been updated yet
+            }
+
+            position[i] = start + delta;
+            if (age[i] >= lifetime) {
+                kill(i);
+                continue;
+            }
+            ++i;
+        }
+    }
+
+    // interpolated render position of round i, alpha in [0, 1)
+    glm::vec3 getRenderPosition(std::size_t i, float alpha) const {
+        return glm::mix(previous[i], position[i], alpha);
+    }
+
+    const glm::vec3& getPosition(std::size_t i) const { return position[i]; }
+    const glm::vec3& getVelocity(std::size_t i) const { return velocity[i]; }
+    // light slot held by round i, NoLight when none was free at spawn
+    std::uint32_t getLight(std::size_t i) const { return light[i]; }
+
+private:
+    std::vector<glm::vec3> position;
+    std::vector<glm::vec3> previous;
+    std::vector<glm::vec3> velocity;
+    std::vector<float> age;
+    std::vector<std::uint32_t> light;
+    std::vector<std::uint32_t> freeLights;
+    std::size_t lightSlots = 1024;
+    std::size_t alive = 0;
+
+    void kill(std::size_t i) {
+        if (light[i] != NoLight) {
+            freeLights.push_back(light[i]);
+            std::push_heap(freeLights.begin(), freeLights.end(), std::greater<>());
+        }
+        --alive;
+        position[i] = position[alive];
+        previous[i] = previous[alive];
+        velocity[i] = velocity[alive];
+        age[i] = age[alive];
+        light[i] = light[alive];
+    }
+
+    // segment p0 + d*t, t in [0, 1] against a box (slab test)
+    static bool segmentAABB(const glm::vec3& p0, const glm::vec3& d, const AABB& box, float& tEnter, glm::vec3& normal) {
+        float tMin = 0.0f, tMax = 1.0f;
+        int axis = -1;
+        float side = 0.0f;
+        for (int a = 0; a < 3; ++a) {
+            if (std::abs(d[a]) < 1e-8f) {
+                if (p0[a] < box.min[a] || p0[a] > box.max[a]) return false;
+                continue;
+            }
+            float inv = 1.0f / d[a];
+            float t1 = (box.min[a] - p0[a]) * inv;
+            float t2 = (box.max[a] - p0[a]) * inv;
+            float s = -1.0f; // entering through the min face
+            if (t1 > t2) { std::swap(t1, t2); s = 1.0f; }
+            if (t1 > tMin) { tMin = t1; axis = a; side = s; }
+            tMax = std::min(tMax, t2);
+            if (tMin > tMax) return false;
+        }
+        tEnter = tMin;
+        normal = glm::vec3(0.0f);
+        if (axis >= 0) normal[axis] = side;
+        else if (glm::length(d) > 0.0f) normal = -glm::normalize(d); // started inside
+        return true;
+    }
+
+    // swept sphere against object boxes, boxes are inflated by the radius
+    bool sweepBroadphase(const glm::vec3& p0, const glm::vec3& d, const DynamicAABBTree& broadphase, float& tHit, ProjectileHit& hit) const {
+        glm::vec3 p1 = p0 + d;
+        AABB swept(glm::min(p0, p1) - glm::vec3(radius), glm::max(p0, p1) + glm::vec3(radius));
+        bool found = false;
+        broadphase.query(swept, [&](int proxy) {
+            if (!(broadphase.getLayer(proxy) & collisionMask)) return true;
+            const AABB& box = broadphase.getAABB(proxy);
+            AABB inflated(box.min - glm::vec3(radius), box.max + glm::vec3(radius));
+            float t;
+            glm::vec3 n;
+            if (segmentAABB(p0, d, inflated, t, n) && t < tHit) {
+                tHit = t;
+                hit.normal = n;
+                hit.target = broadphase.getUserData(proxy);
+                hit.terrain = false;
+                found = true;
+            }
+            return true;
+        });
+        return found;
+    }
+
+    // march the segment over the heightmap at cell resolution
+    bool sweepTerrain(const glm::vec3& p0, const glm::vec3& d, Terrain& terrain, float& tHit, ProjectileHit& hit) const {
+        float lowest = std::min(p0.y, p0.y + d.y * tHit) - radius;
+        if (lowest > terrain.getMaxHeight()) return false; // entirely above the highest point
+
+        float cell = terrain.getCellSize();
+        float lengthXZ = glm::length(glm::vec2(d.x, d.z)) * tHit;
+        int samples = std::max(1, static_cast<int>(std::ceil(lengthXZ / cell)));
+
+        auto below = [&](float t) {
+            glm::vec3 p = p0 + d * t;
+            return p.y - radius <= terrain.getHeightAt(p.x, p.z);
+        };
+        if (below(0.0f)) {
+            tHit = 0.0f;
+        }
+        else {
+            float tPrev = 0.0f;
+            bool crossed = false;
+            for (int s = 1; s <= samples; ++s) {
+                float t = tHit * s / samples;
+                if (below(t)) {
+                    // refine the crossing between the last two samples
+                    float lo = tPrev, hi = t;
+                    for (int it = 0; it < 6; ++it) {
+                        float mid = 0.5f * (lo + hi);
+                        if (below(mid)) hi = mid; else lo = mid;
+                    }
+                    tHit = hi;
+                    crossed = true;
+                    break;
+                }
+                tPrev = t;
+            }
+            if (!crossed) return false;
+        }
+
+        // normal from central differences of the height field
+        glm::vec3 p = p0 + d * tHit;
+        float hx = terrain.getHeightAt(p.x + cell, p.z) - terrain.getHeightAt(p.x - cell, p.z);
+        float hz = terrain.getHeightAt(p.x, p.z + cell) - terrain.getHeightAt(p.x, p.z - cell);
+        hit.normal = glm::normalize(glm::vec3(-hx, 2.0f * cell, -hz));
+        hit.target = 0;
+        hit.terrain = true;
+        return true;
+    }
+};
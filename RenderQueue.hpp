@@ -0,0 +1,135 @@
+#pragma once
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <array>
+#include <bit>
+#include <cstdint>
+#include <vector>
+
+#include "Mesh.hpp"
+
+// Draws encoded as 64 bit sort keys plus a payload, ordered with an LSD radix
+// sort (linear in the number of draws) and submitted in key order while
+// skipping shader, texture and VAO binds that are already current.
+//
+// Key layout, most significant first:
+//   opaque      | pass:2 | shader:8 | texture:12 | geometry:16 | depth:24 | 2 unused
+//   transparent | pass:2 | inverted depth:32 | shader:8 | texture:12 | 10 unused
+// Opaque draws group by state and go front to back inside a state, transparent
+// draws go strictly back to front. Ids are truncated to their fields; a
+// collision only costs an extra bind, never a wrong draw.
+class RenderQueue {
+public:
+    enum Pass : std::uint64_t { Opaque = 0, Transparent = 1 };
+
+    struct Item {
+        std::uint64_t key;
+        std::uint32_t payload;
+    };
+
+    // depth: any monotonic distance measure >= 0, e.g. the squared distance
+    static std::uint64_t opaqueKey(GLuint shader, GLuint texture, GLuint geometry, float depth) {
+        return (std::uint64_t(Opaque) << 62)
+            | (std::uint64_t(shader & 0xFFu) << 54)
+            | (std::uint64_t(texture & 0xFFFu) << 42)
+            | (std::uint64_t(geometry & 0xFFFFu) << 26)
+            | (std::uint64_t(depthBits(depth) >> 8) << 2);
+    }
+
+    static std::uint64_t transparentKey(float depth, GLuint shader, GLuint texture) {
+        return (std::uint64_t(Transparent) << 62)
+            | (std::uint64_t(~depthBits(depth)) << 30)
+            | (std::uint64_t(shader & 0xFFu) << 22)
+            | (std::uint64_t(texture & 0xFFFu) << 10);
+    }
+
+    void clear() {
+        items.clear();
+        draws.clear();
+    }
+
+    void add(std::uint64_t key, Mesh& mesh, const glm::mat4& model) {
+        items.push_back({ key, static_cast<std::uint32_t>(draws.size()) });
+        draws.push_back({ &mesh, model });
+    }
+
+    std::size_t size() const { return items.size(); }
+
+    // sort and draw everything queued, returns the number of state changes
+    int submit(const glm::mat4& projection, const glm::mat4& view, const glm::vec3& viewPos) {
+        if (items.empty()) return 0;
+        radixSort(items, scratch);
+
+        ShaderProgram* shader = nullptr;
+        GLuint texture = UINT32_MAX, vao = UINT32_MAX;
+        int changes = 0;
+        for (const Item& item : items) {
+            Draw& d = draws[item.payload];
+            Mesh& mesh = *d.mesh;
+            if (&mesh.shader != shader) {
+                shader = &mesh.shader;
+                shader->activate();
+                shader->setUniform("uP_m", projection);
+                shader->setUniform("uV_m", view);
+                shader->setUniform("uInstanced", 0);
+                shader->setUniform("viewPos", viewPos);
+                shader->setUniform("tex0", 0);
+                texture = UINT32_MAX;
+                ++changes;
+            }
+            if (mesh.texture_id != texture) {
+                texture = mesh.texture_id;
+                if (texture != 0) glBindTextureUnit(0, texture);
+                else glBindTexture(GL_TEXTURE_2D, 0);
+                ++changes;
+            }
+            if (mesh.getVAO() != vao) {
+                vao = mesh.getVAO();
+                glBindVertexArray(vao);
+                ++changes;
+            }
+            shader->setUniform("uM_m", d.model);
+            glDrawElements(mesh.primitive_type, static_cast<GLsizei>(mesh.indices.size()), GL_UNSIGNED_INT, 0);
+        }
+        glBindVertexArray(0);
+        shader->deactivate();
+        return changes;
+    }
+
+    // stable LSD radix sort on the key, one byte per pass; bytes that are the
+    // same in every key are skipped, so sparse keys cost fewer passes
+    static void radixSort(std::vector<Item>& data, std::vector<Item>& tmp) {
+        if (data.size() < 2) return;
+        tmp.resize(data.size());
+        std::array<std::array<std::uint32_t, 256>, 8> counts{};
+        for (const Item& item : data) {
+            for (int b = 0; b < 8; ++b) counts[b][(item.key >> (8 * b)) & 0xFF]++;
+        }
+        for (int b = 0; b < 8; ++b) {
+            auto& c = counts[b];
+            if (c[(data[0].key >> (8 * b)) & 0xFF] == data.size()) continue;
+            std::uint32_t sum = 0;
+            for (auto& n : c) {
+                std::uint32_t v = n;
+                n = sum;
+                sum += v;
+            }
+            for (const Item& item : data) tmp[c[(item.key >> (8 * b)) & 0xFF]++] = item;
+            data.swap(tmp);
+        }
+    }
+
+private:
+    struct Draw {
+        Mesh* mesh;
+        glm::mat4 model;
+    };
+
+    std::vector<Item> items, scratch;
+    std::vector<Draw> draws;
+
+    // bits of a non-negative float order like the float
+    static std::uint32_t depthBits(float depth) {
+        return std::bit_cast<std::uint32_t>(depth > 0.0f ? depth : 0.0f);
+    }
+};
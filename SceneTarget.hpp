@@ -0,0 +1,66 @@
+#pragma once
+#include <GL/glew.h>
+#include <algorithm>
+
+// Framebuffer the scene is rendered into: RGBA8 colour and 32F depth at
+// window size, multisampled when MSAA is on. Passes that read the scene depth
+// (soft particles, Hi-Z pyramid) blit it from here into their own 32F copy,
+// which is valid since the formats match; the default framebuffer depth has
+// an unknown format and may be multisampled. present() resolves the colour
+// into the default framebuffer before the swap.
+class SceneTarget {
+public:
+    SceneTarget() = default;
+    SceneTarget(const SceneTarget&) = delete;
+    SceneTarget& operator=(const SceneTarget&) = delete;
+    ~SceneTarget() { clear(); }
+
+    // window size and MSAA samples (0 = single sample), recreated on the next bind
+    void setViewport(int w, int h) {
+        width = std::max(w, 1);
+        height = std::max(h, 1);
+    }
+    void setSamples(int count) { samples = std::max(count, 0); }
+
+    GLuint getFramebuffer() const { return framebuffer; }
+
+    void bind() {
+        if (!framebuffer || bufferWidth != width || bufferHeight != height || bufferSamples != samples) create();
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    }
+
+    // resolve the colour into the default framebuffer
+    void present() {
+        if (!framebuffer) return;
+        glBlitNamedFramebuffer(framebuffer, 0, 0, 0, bufferWidth, bufferHeight, 0, 0, bufferWidth, bufferHeight,
+            GL_COLOR_BUFFER_BIT, GL_NEAREST);
+    }
+
+    void clear() {
+        if (framebuffer) glDeleteFramebuffers(1, &framebuffer);
+        if (color) glDeleteRenderbuffers(1, &color);
+        if (depth) glDeleteRenderbuffers(1, &depth);
+        framebuffer = color = depth = 0;
+        bufferWidth = bufferHeight = bufferSamples = 0;
+    }
+
+private:
+    GLuint framebuffer = 0, color = 0, depth = 0;
+    int width = 1, height = 1, samples = 0;
+    int bufferWidth = 0, bufferHeight = 0, bufferSamples = 0;
+
+    void create() {
+        clear();
+        glCreateRenderbuffers(1, &color);
+        glNamedRenderbufferStorageMultisample(color, samples, GL_RGBA8, width, height);
+        glCreateRenderbuffers(1, &depth);
+        glNamedRenderbufferStorageMultisample(depth, samples, GL_DEPTH_COMPONENT32F, width, height);
+
+        glCreateFramebuffers(1, &framebuffer);
+        glNamedFramebufferRenderbuffer(framebuffer, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, color);
+        glNamedFramebufferRenderbuffer(framebuffer, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depth);
+        bufferWidth = width;
+        bufferHeight = height;
+        bufferSamples = samples;
+    }
+};
\ No newline at end of file
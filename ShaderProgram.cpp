@@ -20,17 +20,20 @@ ShaderProgram::ShaderProgram(const std::filesystem::path& VS_file, const std::fi
 	ID = link_shader(shader_ids);
 }
 
+ShaderProgram::ShaderProgram(const std::filesystem::path& CS_file) {
+	// compute pipeline has a single stage
+	ID = link_shader({ compile_shader(CS_file, GL_COMPUTE_SHADER) });
+}
+
 GLint ShaderProgram::getUniformLocation(const std::string& name) {
 
 	auto it = uniformCache.find(name);
 	if (it != uniformCache.end()) return it->second;
 
 	GLint location = glGetUniformLocation(ID, name.c_str());
-	if (location == -1) {
-		std::cerr << "Warning: uniform '" << name << "' not found in shader.\n";
-		return location;
-	}
+	// missing uniforms are cached too, the warning is printed once per program
 	uniformCache[name] = location;
+	if (location == -1) std::cerr << "Warning: uniform '" << name << "' not found in shader.\n";
 	return location;
 
 }
@@ -13,11 +13,13 @@ public:
     // you can add more constructors for pipeline with GS, TS etc.
     ShaderProgram(void) = default; //does nothing
     ShaderProgram(const std::filesystem::path& VS_file, const std::filesystem::path& FS_file); // implementation of load, compile, and link shader
+    explicit ShaderProgram(const std::filesystem::path& CS_file); // compute shader program
 
     void activate(void) { glUseProgram(ID); };    // activate shader
     void deactivate(void) { glUseProgram(0); };   // deactivate current shader program (i.e. activate shader no. 0)
 
     void clear(void) { 	//deallocate shader program
+        if (ID == 0) return; // never linked (e.g. no GL context)
         deactivate();
         glDeleteProgram(ID);
         ID = 0;
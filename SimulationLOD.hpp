@@ -0,0 +1,80 @@
+#pragma once
+#include <glm/glm.hpp>
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+// Distance bands for simulation level of detail. An entity in a band with
+// interval N is simulated on every Nth tick with N times the tick length.
+// Each entity has its own phase so the entities of a band are spread evenly
+// over the N ticks instead of all updating on the same one.
+class SimulationLOD {
+public:
+    struct Band {
+        float maxDistance;   // upper bound of the band, FLT_MAX for the last one
+        int interval;        // simulate every interval ticks
+    };
+
+    struct BandStats {
+        int entities = 0;    // entities in the band this tick
+        int simulated = 0;   // of those, updated this tick
+    };
+
+    bool enabled = true;
+    int offscreenShift = 1;      // off-screen entities drop this many bands
+    float viewConeCos = 0.5f;    // cos of the half angle counted as on screen
+
+    SimulationLOD() { setBands({ { 20.0f, 1 }, { 50.0f, 4 }, { FLT_MAX, 16 } }); }
+
+    void setBands(std::vector<Band> newBands) {
+        bands = std::move(newBands);
+        std::sort(bands.begin(), bands.end(), [](const Band& a, const Band& b) { return a.maxDistance < b.maxDistance; });
+        if (bands.empty()) bands.push_back({ FLT_MAX, 1 });
+        bands.back().maxDistance = FLT_MAX;
+        for (auto& b : bands) b.interval = std::max(1, b.interval);
+        stats.assign(bands.size(), BandStats());
+    }
+
+    const std::vector<Band>& getBands() const { return bands; }
+    const std::vector<BandStats>& getStats() const { return stats; }
+
+    // start a simulation tick, also resets the statistics
+    void beginTick(const glm::vec3& viewPosition, const glm::vec3& viewDirection) {
+        ++tick;
+        eye = viewPosition;
+        forward = glm::normalize(viewDirection);
+        std::fill(stats.begin(), stats.end(), BandStats());
+    }
+
+    std::uint64_t getTick() const { return tick; }
+
+    // band of a position: by distance, pushed further out when behind the camera
+    int bandOf(const glm::vec3& position) const {
+        if (!enabled) return 0;
+        glm::vec3 toEntity = position - eye;
+        float distance = glm::length(toEntity);
+        int band = 0;
+        while (distance > bands[band].maxDistance) ++band;
+        bool onScreen = distance < 1e-4f || glm::dot(toEntity / distance, forward) >= viewConeCos;
+        if (!onScreen) band += offscreenShift;
+        return std::min(band, static_cast<int>(bands.size()) - 1);
+    }
+
+    // true if an entity with the given phase and band is simulated this tick
+    bool isDue(int band, std::uint32_t phase) {
+        stats[band].entities++;
+        int interval = bands[band].interval;
+        if ((tick + phase) % interval != 0) return false;
+        stats[band].simulated++;
+        return true;
+    }
+
+private:
+    std::vector<Band> bands;
+    std::vector<BandStats> stats;
+    std::uint64_t tick = 0;
+    glm::vec3 eye{ 0.0f };
+    glm::vec3 forward{ 0.0f, 0.0f, -1.0f };
+};
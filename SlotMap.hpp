@@ -0,0 +1,130 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <utility>
+#include <vector>
+
+// Dense container with stable generational handles.
+// Values are packed in one array (iteration is a linear walk), a slot table
+// maps handles to their current position. Erasing moves the last value into
+// the hole and bumps the slot generation, so handles to erased values are
+// detected instead of silently pointing at another object.
+// Pointers to values are only valid until the next insert or erase.
+template<typename T>
+class SlotMap {
+public:
+    struct Handle {
+        std::uint32_t index = UINT32_MAX;
+        std::uint32_t generation = 0;
+
+        bool isNull() const { return index == UINT32_MAX; }
+        bool operator==(const Handle& o) const { return index == o.index && generation == o.generation; }
+        bool operator!=(const Handle& o) const { return !(*this == o); }
+
+        // packed form for 64 bit user data fields
+        std::uint64_t toBits() const { return (static_cast<std::uint64_t>(generation) << 32) | index; }
+        static Handle fromBits(std::uint64_t bits) {
+            return Handle{ static_cast<std::uint32_t>(bits), static_cast<std::uint32_t>(bits >> 32) };
+        }
+    };
+
+    void reserve(std::size_t n) {
+        values.reserve(n);
+        valueSlot.reserve(n);
+        slots.reserve(n);
+    }
+
+    template<typename... Args>
+    Handle emplace(Args&&... args) {
+        std::uint32_t slot;
+        if (freeHead != UINT32_MAX) {
+            slot = freeHead;
+            freeHead = slots[slot].target;
+        }
+        else {
+            slot = static_cast<std::uint32_t>(slots.size());
+            slots.push_back(Slot());
+        }
+        values.emplace_back(std::forward<Args>(args)...);
+        valueSlot.push_back(slot);
+        slots[slot].target = static_cast<std::uint32_t>(values.size() - 1);
+        slots[slot].alive = true;
+        return Handle{ slot, slots[slot].generation };
+    }
+
+    Handle insert(T&& value) { return emplace(std::move(value)); }
+
+    // false for null or stale handles
+    bool erase(Handle h) {
+        if (!contains(h)) return false;
+        Slot& s = slots[h.index];
+        std::uint32_t hole = s.target;
+        std::uint32_t last = static_cast<std::uint32_t>(values.size() - 1);
+        if (hole != last) {
+            // rebuild in place instead of assigning, T may not be assignable
+            std::destroy_at(&values[hole]);
+            std::construct_at(&values[hole], std::move(values[last]));
+            valueSlot[hole] = valueSlot[last];
+            slots[valueSlot[hole]].target = hole;
+        }
+        values.pop_back();
+        valueSlot.pop_back();
+
+        s.alive = false;
+        s.generation++;
+        s.target = freeHead;
+        freeHead = h.index;
+        return true;
+    }
+
+    bool contains(Handle h) const {
+        return h.index < slots.size() && slots[h.index].alive && slots[h.index].generation == h.generation;
+    }
+
+    // nullptr for null or stale handles
+    T* get(Handle h) { return contains(h) ? &values[slots[h.index].target] : nullptr; }
+    const T* get(Handle h) const { return contains(h) ? &values[slots[h.index].target] : nullptr; }
+
+    // handle of the value at a dense position, e.g. while iterating
+    Handle handleAt(std::size_t position) const {
+        std::uint32_t slot = valueSlot[position];
+        return Handle{ slot, slots[slot].generation };
+    }
+
+    void clear() {
+        // all outstanding handles become stale
+        for (std::uint32_t i : valueSlot) {
+            slots[i].alive = false;
+            slots[i].generation++;
+            slots[i].target = freeHead;
+            freeHead = i;
+        }
+        values.clear();
+        valueSlot.clear();
+    }
+
+    std::size_t size() const { return values.size(); }
+    bool empty() const { return values.empty(); }
+
+    T* data() { return values.data(); }
+    const T* data() const { return values.data(); }
+    T& operator[](std::size_t position) { return values[position]; }
+    const T& operator[](std::size_t position) const { return values[position]; }
+
+    auto begin() { return values.begin(); }
+    auto end() { return values.end(); }
+    auto begin() const { return values.begin(); }
+    auto end() const { return values.end(); }
+
+private:
+    struct Slot {
+        std::uint32_t target = 0;      // dense position when alive, next free slot otherwise
+        std::uint32_t generation = 0;
+        bool alive = false;
+    };
+
+    std::vector<T> values;
+    std::vector<std::uint32_t> valueSlot;   // dense position -> slot
+    std::vector<Slot> slots;
+    std::uint32_t freeHead = UINT32_MAX;
+};
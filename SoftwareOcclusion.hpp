@@ -0,0 +1,240 @@
+#pragma once
+#include <glm/glm.hpp>
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
+
+#include "AABBTree.hpp"
+#include "JobSystem.hpp"
+#include "Model.hpp"
+
+// CPU occlusion culling for contexts without GPU culling. A few coarse
+// occluders (a low resolution copy of the terrain, large models) are
+// rasterized into a small depth buffer on the job workers, then boxes are
+// tested against it in the same frame, so there is no read back and no
+// frame of latency.
+//
+// Both sides are conservative: the terrain occluder lies on or below the
+// real surface, occluder pixels store the farthest depth the triangle has
+// inside the pixel and a tested box rectangle grows by one pixel. A box is
+// only rejected when every pixel it can touch is closer than its nearest
+// point, so culling cannot make anything pop.
+class SoftwareOcclusion {
+public:
+    SoftwareOcclusion() { setResolution(256, 192); }
+
+    // buffer size in pixels, the width is rounded up to the SIMD width
+    void setResolution(int w, int h) {
+        width = (std::max(w, 4) + 3) / 4 * 4;
+        height = std::max(h, 1);
+        depth.assign(std::size_t(width) * height, 1.0f);
+    }
+
+    int getWidth() const { return width; }
+    int getHeight() const { return height; }
+
+    // static occluder: chunks x chunks quads over the terrain, every vertex
+    // at the lowest height of the heightmap cells around it
+    void setTerrain(Terrain& terrain, int chunks = 48) {
+        terrainVertices.clear();
+        terrainIndices.clear();
+        chunks = std::max(chunks, 1);
+        glm::vec3 lo = terrain.getAABBMin(), hi = terrain.getAABBMax();
+        float dx = (hi.x - lo.x) / chunks, dz = (hi.z - lo.z) / chunks;
+        float step = std::max(terrain.getCellSize(), 1e-3f);
+
+        std::vector<float> cellMin(std::size_t(chunks) * chunks, FLT_MAX);
+        for (int j = 0; j < chunks; ++j) {
+            for (int i = 0; i < chunks; ++i) {
+                float& m = cellMin[std::size_t(j) * chunks + i];
+                for (float z = lo.z + j * dz; z <= lo.z + (j + 1) * dz + 1e-4f; z += step) {
+                    for (float x = lo.x + i * dx; x <= lo.x + (i + 1) * dx + 1e-4f; x += step) {
+                        m = std::min(m, terrain.getHeightAt(x, z));
+                    }
+                }
+            }
+        }
+        for (int j = 0; j <= chunks; ++j) {
+            for (int i = 0; i <= chunks; ++i) {
+                float h = FLT_MAX;
+                for (int cj = std::max(j - 1, 0); cj <= std::min(j, chunks - 1); ++cj) {
+                    for (int ci = std::max(i - 1, 0); ci <= std::min(i, chunks - 1); ++ci) {
+                        h = std::min(h, cellMin[std::size_t(cj) * chunks + ci]);
+                    }
+                }
+                terrainVertices.emplace_back(lo.x + i * dx, h, lo.z + j * dz);
+            }
+        }
+        for (int j = 0; j < chunks; ++j) {
+            for (int i = 0; i < chunks; ++i) {
+                std::uint32_t a = j * (chunks + 1) + i, b = a + 1, c = a + chunks + 1, d = c + 1;
+                terrainIndices.insert(terrainIndices.end(), { a, c, b, b, c, d });
+            }
+        }
+    }
+
+    // drop the occluders added for the previous frame, the terrain stays
+    void beginFrame() {
+        vertices.assign(terrainVertices.begin(), terrainVertices.end());
+        indices.assign(terrainIndices.begin(), terrainIndices.end());
+    }
+
+    // the model's triangles in world space, for this frame only; models over
+    // the triangle budget are skipped, they would cost more than they save
+    bool addOccluder(Model& model, std::size_t maxTriangles = 2048) {
+        std::size_t triangles = 0;
+        for (const Mesh& mesh : model.meshes) {
+            if (mesh.primitive_type != GL_TRIANGLES) return false;
+            triangles += mesh.indices.size() / 3;
+        }
+        if (triangles == 0 || triangles > maxTriangles) return false;
+        model.updateAABBAndModelMatrix();
+        for (const Mesh& mesh : model.meshes) {
+            std::uint32_t base = static_cast<std::uint32_t>(vertices.size());
+            for (const Vertex& v : mesh.vertices) vertices.emplace_back(model.modelMatrix * glm::vec4(v.position, 1.0f));
+            for (GLuint i : mesh.indices) indices.push_back(base + i);
+        }
+        return true;
+    }
+
+    // rasterize this frame's occluders for projection * view
+    void render(const glm::mat4& viewProjection, JobSystem& jobs) {
+        transform = viewProjection;
+        std::fill(depth.begin(), depth.end(), 1.0f);
+
+        // vertices to screen space: x, y in pixels, z in [0, 1], w < 0 behind the near plane
+        screen.resize(vertices.size());
+        jobs.parallelFor(0, vertices.size(), 1024, [&](std::size_t first, std::size_t last) {
+            for (std::size_t i = first; i < last; ++i) screen[i] = toScreen(vertices[i]);
+        });
+
+        // bands of rows are independent, every worker walks all triangles but
+        // only writes its own rows
+        int bands = (height + BandRows - 1) / BandRows;
+        jobs.parallelFor(0, std::size_t(bands), 1, [&](std::size_t first, std::size_t last) {
+            for (std::size_t b = first; b < last; ++b) {
+                int y0 = int(b) * BandRows, y1 = std::min(y0 + BandRows, height) - 1;
+                for (std::size_t t = 0; t + 2 < indices.size(); t += 3) {
+                    rasterize(screen[indices[t]], screen[indices[t + 1]], screen[indices[t + 2]], y0, y1);
+                }
+            }
+        });
+    }
+
+    std::size_t occluderTriangles() const { return indices.size() / 3; }
+
+    // false only when the box is hidden behind the rendered occluders
+    bool visible(const AABB& box) const {
+        float xMin = FLT_MAX, yMin = FLT_MAX, xMax = -FLT_MAX, yMax = -FLT_MAX, nearest = FLT_MAX;
+        for (int i = 0; i < 8; ++i) {
+            glm::vec3 corner((i & 1) ? box.max.x : box.min.x, (i & 2) ? box.max.y : box.min.y, (i & 4) ? box.max.z : box.min.z);
+            glm::vec4 s = toScreen(corner);
+            // crosses the near plane
+            if (s.w <= 0.0f) return true;
+            xMin = std::min(xMin, s.x); xMax = std::max(xMax, s.x);
+            yMin = std::min(yMin, s.y); yMax = std::max(yMax, s.y);
+            nearest = std::min(nearest, s.z);
+        }
+        if (xMax < 0.0f || yMax < 0.0f || xMin >= width || yMin >= height) return true;   // left to frustum culling
+
+        // one pixel of slack for partially covered occluder pixels
+        int x0 = std::max(int(std::floor(xMin)) - 1, 0), x1 = std::min(int(std::floor(xMax)) + 1, width - 1);
+        int y0 = std::max(int(std::floor(yMin)) - 1, 0), y1 = std::min(int(std::floor(yMax)) + 1, height - 1);
+        for (int y = y0; y <= y1; ++y) {
+            const float* row = depth.data() + std::size_t(y) * width;
+            int x = x0;
+#if defined(__SSE2__) || defined(_M_X64)
+            __m128 n = _mm_set1_ps(nearest);
+            for (; x + 3 <= x1; x += 4) {
+                if (_mm_movemask_ps(_mm_cmpge_ps(_mm_loadu_ps(row + x), n))) return true;
+            }
+#endif
+            for (; x <= x1; ++x) {
+                if (row[x] >= nearest) return true;
+            }
+        }
+        return false;
+    }
+
+private:
+    static constexpr int BandRows = 16;
+
+    int width = 0, height = 0;
+    std::vector<float> depth;                  // row major, 1 = far
+    glm::mat4 transform{ 1.0f };
+    std::vector<glm::vec3> terrainVertices;
+    std::vector<std::uint32_t> terrainIndices;
+    std::vector<glm::vec3> vertices;           // this frame, world space
+    std::vector<std::uint32_t> indices;
+    std::vector<glm::vec4> screen;
+
+    glm::vec4 toScreen(const glm::vec3& p) const {
+        glm::vec4 clip = transform * glm::vec4(p, 1.0f);
+        if (clip.w <= 1e-4f) return glm::vec4(0.0f, 0.0f, 0.0f, -1.0f);
+        glm::vec3 ndc = glm::vec3(clip) / clip.w;
+        return glm::vec4((ndc.x * 0.5f + 0.5f) * width, (ndc.y * 0.5f + 0.5f) * height, ndc.z * 0.5f + 0.5f, 1.0f);
+    }
+
+    // rows y0..y1 of one triangle, pixel centers inside the triangle keep the
+    // minimum of the stored depth and the farthest triangle depth in the pixel
+    void rasterize(glm::vec4 a, glm::vec4 b, glm::vec4 c, int y0, int y1) {
+        // triangles crossing the near plane are not clipped, only dropped
+        if (a.w <= 0.0f || b.w <= 0.0f || c.w <= 0.0f) return;
+        float area = (b.x - a.x) * (c.y - a.y) - (b.y - a.y) * (c.x - a.x);
+        if (std::abs(area) < 1e-6f) return;
+        if (area < 0.0f) { std::swap(b, c); area = -area; }   // occluders are two sided
+
+        int minX = std::max(int(std::floor(std::min({ a.x, b.x, c.x }))), 0);
+        int maxX = std::min(int(std::floor(std::max({ a.x, b.x, c.x }))), width - 1);
+        int minY = std::max(int(std::floor(std::min({ a.y, b.y, c.y }))), y0);
+        int maxY = std::min(int(std::floor(std::max({ a.y, b.y, c.y }))), y1);
+        if (minX > maxX || minY > maxY) return;
+
+        // edge functions e(x, y) = A x + B y + C, >= 0 inside
+        float A0 = a.y - b.y, B0 = b.x - a.x, C0 = a.x * b.y - a.y * b.x;
+        float A1 = b.y - c.y, B1 = c.x - b.x, C1 = b.x * c.y - b.y * c.x;
+        float A2 = c.y - a.y, B2 = a.x - c.x, C2 = c.x * a.y - c.y * a.x;
+        // depth plane, pushed back by half a pixel of slope and capped at the farthest vertex
+        float dzdx = ((b.z - a.z) * (c.y - a.y) - (c.z - a.z) * (b.y - a.y)) / area;
+        float dzdy = ((c.z - a.z) * (b.x - a.x) - (b.z - a.z) * (c.x - a.x)) / area;
+        float z0 = a.z - dzdx * a.x - dzdy * a.y + 0.5f * (std::abs(dzdx) + std::abs(dzdy));
+        float zMax = std::max({ a.z, b.z, c.z });
+
+        int startX = minX & ~3;
+        for (int y = minY; y <= maxY; ++y) {
+            float py = y + 0.5f;
+            float* row = depth.data() + std::size_t(y) * width;
+            int x = startX;
+#if defined(__SSE2__) || defined(_M_X64)
+            __m128 px = _mm_add_ps(_mm_set1_ps(float(x)), _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f));
+            __m128 four = _mm_set1_ps(4.0f), zero = _mm_setzero_ps(), zCap = _mm_set1_ps(zMax);
+            __m128 a0 = _mm_set1_ps(A0), a1 = _mm_set1_ps(A1), a2 = _mm_set1_ps(A2), dz = _mm_set1_ps(dzdx);
+            __m128 r0 = _mm_set1_ps(B0 * py + C0), r1 = _mm_set1_ps(B1 * py + C1), r2 = _mm_set1_ps(B2 * py + C2);
+            __m128 rz = _mm_set1_ps(dzdy * py + z0);
+            for (; x <= maxX; x += 4) {
+                __m128 inside = _mm_and_ps(_mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(a0, px), r0), zero),
+                    _mm_and_ps(_mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(a1, px), r1), zero),
+                        _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(a2, px), r2), zero)));
+                if (_mm_movemask_ps(inside)) {
+                    __m128 z = _mm_min_ps(_mm_add_ps(_mm_mul_ps(dz, px), rz), zCap);
+                    __m128 old = _mm_loadu_ps(row + x);
+                    __m128 merged = _mm_min_ps(old, z);
+                    _mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, merged), _mm_andnot_ps(inside, old)));
+                }
+                px = _mm_add_ps(px, four);
+            }
+#else
+            for (; x <= maxX; ++x) {
+                float px = x + 0.5f;
+                if (A0 * px + B0 * py + C0 < 0.0f || A1 * px + B1 * py + C1 < 0.0f || A2 * px + B2 * py + C2 < 0.0f) continue;
+                row[x] = std::min(row[x], std::min(dzdx * px + dzdy * py + z0, zMax));
+            }
+#endif
+        }
+    }
+};
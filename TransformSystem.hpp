@@ -0,0 +1,235 @@
+#pragma once
+#include <glm/glm.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "AABBTree.hpp"
+
+// Transform hierarchy stored as parallel arrays.
+// Setters only mark a node dirty when the value really changes. update()
+// then works on the dirty nodes and their descendants only, in separate
+// passes over contiguous data: local matrices, world matrices (parents
+// first) and world bounds. getChanged() lists the nodes whose world
+// transform changed so the owner can copy results out.
+class TransformSystem {
+public:
+    using Node = std::uint32_t;
+    static constexpr Node Null = UINT32_MAX;
+
+    Node create(const glm::vec3& position = glm::vec3(0.0f), const glm::vec3& rotation = glm::vec3(0.0f),
+        const glm::vec3& scale = glm::vec3(1.0f), Node parentNode = Null, std::uint64_t user = 0) {
+        Node n;
+        if (!freeNodes.empty()) {
+            n = freeNodes.back();
+            freeNodes.pop_back();
+        }
+        else {
+            n = static_cast<Node>(alive.size());
+            grow();
+        }
+        alive[n] = 1;
+        localPosition[n] = position;
+        localRotation[n] = rotation;
+        localScale[n] = scale;
+        boundsCenter[n] = glm::vec3(0.0f);
+        boundsHalfExtents[n] = glm::vec3(0.0f);
+        parent[n] = Null;
+        firstChild[n] = Null;
+        nextSibling[n] = Null;
+        depth[n] = 0;
+        userData[n] = user;
+        stamp[n] = 0;
+        link(n, parentNode);
+        markDirty(n);
+        return n;
+    }
+
+    // children are detached and become roots
+    void destroy(Node n) {
+        if (!valid(n)) return;
+        while (firstChild[n] != Null) setParent(firstChild[n], Null);
+        unlink(n);
+        alive[n] = 0;
+        freeNodes.push_back(n);
+    }
+
+    bool valid(Node n) const { return n < alive.size() && alive[n]; }
+
+    // keeps the local transform, i.e. the node moves with its new parent
+    void setParent(Node n, Node newParent) {
+        if (!valid(n) || parent[n] == newParent || n == newParent) return;
+        unlink(n);
+        link(n, newParent);
+        markDirty(n);
+    }
+
+    void setPosition(Node n, const glm::vec3& p) {
+        if (localPosition[n] == p) return;
+        localPosition[n] = p;
+        markDirty(n);
+    }
+
+    // euler angles in radians, applied as X then Y then Z (same as Model)
+    void setRotation(Node n, const glm::vec3& r) {
+        if (localRotation[n] == r) return;
+        localRotation[n] = r;
+        markDirty(n);
+    }
+
+    void setScale(Node n, const glm::vec3& s) {
+        if (localScale[n] == s) return;
+        localScale[n] = s;
+        markDirty(n);
+    }
+
+    // model space box, the world box is recomputed with the transform
+    void setLocalBounds(Node n, const glm::vec3& min, const glm::vec3& max) {
+        boundsCenter[n] = (min + max) * 0.5f;
+        boundsHalfExtents[n] = (max - min) * 0.5f;
+        markDirty(n);
+    }
+
+    Node getParent(Node n) const { return parent[n]; }
+    std::uint64_t getUserData(Node n) const { return userData[n]; }
+    const glm::vec3& getPosition(Node n) const { return localPosition[n]; }
+    const glm::mat4& getWorldMatrix(Node n) const { return world[n]; }
+    glm::vec3 getWorldPosition(Node n) const { return glm::vec3(world[n][3]); }
+    AABB getWorldBounds(Node n) const { return AABB(worldMin[n], worldMax[n]); }
+
+    // recompute everything that changed since the last update
+    void update() {
+        changed.clear();
+        ++frame;
+
+        // dirty nodes plus all their descendants, each once
+        for (Node n : dirty) {
+            if (!valid(n) || stamp[n] == frame) continue;
+            collect(n);
+        }
+        dirty.clear();
+        if (changed.empty()) return;
+
+        // parents before children
+        std::sort(changed.begin(), changed.end(), [this](Node a, Node b) { return depth[a] < depth[b]; });
+
+        for (Node n : changed) local[n] = composeLocal(localPosition[n], localRotation[n], localScale[n]);
+
+        for (Node n : changed) world[n] = parent[n] == Null ? local[n] : world[parent[n]] * local[n];
+
+        // world AABB of the transformed box: center moves with the matrix,
+        // extents are the box projected on the world axes (Arvo)
+        for (Node n : changed) {
+            const glm::mat4& m = world[n];
+            const glm::vec3& c = boundsCenter[n];
+            const glm::vec3& e = boundsHalfExtents[n];
+            glm::vec3 center = glm::vec3(m[0]) * c.x + glm::vec3(m[1]) * c.y + glm::vec3(m[2]) * c.z + glm::vec3(m[3]);
+            glm::vec3 extent = glm::abs(glm::vec3(m[0])) * e.x + glm::abs(glm::vec3(m[1])) * e.y + glm::abs(glm::vec3(m[2])) * e.z;
+            worldMin[n] = center - extent;
+            worldMax[n] = center + extent;
+        }
+    }
+
+    // nodes whose world transform was recomputed by the last update()
+    const std::vector<Node>& getChanged() const { return changed; }
+
+    std::size_t size() const { return alive.size() - freeNodes.size(); }
+
+    // translate * rotX * rotY * rotZ * scale without the generic matrix products
+    static glm::mat4 composeLocal(const glm::vec3& p, const glm::vec3& r, const glm::vec3& s) {
+        float sa = std::sin(r.x), ca = std::cos(r.x);
+        float sb = std::sin(r.y), cb = std::cos(r.y);
+        float sc = std::sin(r.z), cc = std::cos(r.z);
+        glm::mat4 m(1.0f);
+        m[0] = glm::vec4(cb * cc, ca * sc + sa * sb * cc, sa * sc - ca * sb * cc, 0.0f) * s.x;
+        m[1] = glm::vec4(-cb * sc, ca * cc - sa * sb * sc, sa * cc + ca * sb * sc, 0.0f) * s.y;
+        m[2] = glm::vec4(sb, -sa * cb, ca * cb, 0.0f) * s.z;
+        m[3] = glm::vec4(p, 1.0f);
+        return m;
+    }
+
+private:
+    // hierarchy
+    std::vector<std::uint8_t> alive;
+    std::vector<Node> parent, firstChild, nextSibling;
+    std::vector<std::uint16_t> depth;
+    // local state
+    std::vector<glm::vec3> localPosition, localRotation, localScale;
+    std::vector<glm::vec3> boundsCenter, boundsHalfExtents;
+    // results
+    std::vector<glm::mat4> local, world;
+    std::vector<glm::vec3> worldMin, worldMax;
+    std::vector<std::uint64_t> userData;
+    // bookkeeping
+    std::vector<std::uint32_t> stamp;
+    std::vector<Node> dirty, changed, freeNodes, stack;
+    std::uint32_t frame = 0;
+
+    void grow() {
+        alive.push_back(0);
+        parent.push_back(Null);
+        firstChild.push_back(Null);
+        nextSibling.push_back(Null);
+        depth.push_back(0);
+        localPosition.emplace_back(0.0f);
+        localRotation.emplace_back(0.0f);
+        localScale.emplace_back(1.0f);
+        boundsCenter.emplace_back(0.0f);
+        boundsHalfExtents.emplace_back(0.0f);
+        local.emplace_back(1.0f);
+        world.emplace_back(1.0f);
+        worldMin.emplace_back(0.0f);
+        worldMax.emplace_back(0.0f);
+        userData.push_back(0);
+        stamp.push_back(0);
+    }
+
+    void markDirty(Node n) { dirty.push_back(n); }
+
+    void link(Node n, Node newParent) {
+        if (!valid(newParent)) newParent = Null;
+        parent[n] = newParent;
+        if (newParent != Null) {
+            nextSibling[n] = firstChild[newParent];
+            firstChild[newParent] = n;
+        }
+        updateDepth(n);
+    }
+
+    void unlink(Node n) {
+        Node p = parent[n];
+        if (p == Null) return;
+        Node* it = &firstChild[p];
+        while (*it != n) it = &nextSibling[*it];
+        *it = nextSibling[n];
+        nextSibling[n] = Null;
+        parent[n] = Null;
+    }
+
+    // depth of n and its subtree after a reparent
+    void updateDepth(Node n) {
+        stack.clear();
+        stack.push_back(n);
+        while (!stack.empty()) {
+            Node i = stack.back();
+            stack.pop_back();
+            depth[i] = parent[i] == Null ? 0 : depth[parent[i]] + 1;
+            for (Node c = firstChild[i]; c != Null; c = nextSibling[c]) stack.push_back(c);
+        }
+    }
+
+    void collect(Node n) {
+        stack.clear();
+        stack.push_back(n);
+        while (!stack.empty()) {
+            Node i = stack.back();
+            stack.pop_back();
+            if (stamp[i] == frame) continue;
+            stamp[i] = frame;
+            changed.push_back(i);
+            for (Node c = firstChild[i]; c != Null; c = nextSibling[c]) stack.push_back(c);
+        }
+    }
+};
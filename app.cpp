@@ -2,14 +2,6 @@
 #include "Particles.hpp"
 
 
-bool AABBintersect(const glm::vec3& minA, const glm::vec3& maxA,
-    const glm::vec3& minB, const glm::vec3& maxB) {
-    return (minA.x <= maxB.x && maxA.x >= minB.x) &&
-        (minA.y <= maxB.y && maxA.y >= minB.y) &&
-        (minA.z <= maxB.z && maxA.z >= minB.z);
-}
-
-
 App::App() : window(nullptr), fov(60.0f), vsync(true), currentColor(1.0f, 0.0f, 0.0f, 1.0f) {
     std::cout << "Application initialized\n";
 }
@@ -31,6 +23,57 @@ void App::loadConfig() {
         fov = config.value("fov", 60.0f);
         AA = config["AA"].value("enabled", false);
         AASamples = config["AA"].value("samples", 0);
+        simClock.setTickRate(config["simulation"].value("tick_rate", 60.0));
+        simClock.maxStepsPerFrame = config["simulation"].value("max_steps_per_frame", 5);
+        if (simClock.maxStepsPerFrame < 1) {
+            // no tick would ever run and the simulation would silently stop
+            std::cerr << "simulation.max_steps_per_frame must be at least 1, using 1\n";
+            simClock.maxStepsPerFrame = 1;
+        }
+        simLOD.enabled = config["simulation"].value("lod_enabled", true);
+        simLOD.offscreenShift = config["simulation"].value("lod_offscreen_shift", 1);
+        if (config["simulation"].contains("lod_bands")) {
+            std::vector<SimulationLOD::Band> bands;
+            for (auto& band : config["simulation"]["lod_bands"]) {
+                bands.push_back({ band.value("distance", FLT_MAX), band.value("interval", 1) });
+            }
+            simLOD.setBands(bands);
+        }
+        projectileSystem.setCapacity(config["projectiles"].value("capacity", 4096));
+        projectileSystem.lifetime = config["projectiles"].value("lifetime", 2.0f);
+        projectileSpeed = config["projectiles"].value("speed", 20.0f);
+        fireRate = config["projectiles"].value("fire_rate", 20.0f);
+        if (!(fireRate > 0.0f)) {
+            // the cooldown would never become positive and the fire loop would not end
+            std::cerr << "projectiles.fire_rate must be positive, using 20\n";
+            fireRate = 20.0f;
+        }
+        particlesOnGPU = config["particles"].value("gpu", true);
+        particleCapacity = config["particles"].value("gpu_capacity", 1u << 20);
+        particleEmitScale = config["particles"].value("emit_scale", 20);
+        sparkCapacity = config["particles"].value("cpu_spark_capacity", std::size_t(1024));
+        impactCapacity = config["particles"].value("cpu_impact_capacity", std::size_t(2048));
+        navCellSize = config["navigation"].value("cell_size", 0.25f);
+        navMaxSlope = config["navigation"].value("max_slope", 1.5f);
+        navSlopeCost = config["navigation"].value("slope_cost", 4.0f);
+        navSliceCells = config["navigation"].value("slice_cells", std::size_t(16384));
+        jobThreads = config["jobs"].value("threads", 0u);
+        projectileSystem.setLightSlots(config["lights"].value("projectile_lights", std::size_t(1024)));
+        clusterTileSize = config["lights"].value("cluster_tile", 64);
+        clusterSlices = config["lights"].value("cluster_slices", 24);
+        occlusionCulling = config["culling"].value("occlusion", true);
+        softwareOcclusion = config["culling"].value("software", true);
+        softwareOcclusionWidth = config["culling"].value("software_width", 256);
+        occluderMinSize = config["culling"].value("occluder_size", 2.0f);
+        std::string path = config["render"].value("path", std::string("forward"));
+        renderPath = path == "deferred" ? RenderPath::Deferred
+            : path == "prepass" ? RenderPath::DepthPrepass : RenderPath::Forward;
+        shadowSettings.cascades = config["shadows"].value("enabled", true) ? config["shadows"].value("cascades", 4) : 0;
+        shadowSettings.resolution = config["shadows"].value("resolution", 2048);
+        shadowSettings.distance = config["shadows"].value("distance", 60.0f);
+        shadowSettings.splitLambda = config["shadows"].value("split_lambda", 0.8f);
+        shadowSettings.sunThreshold = glm::radians(config["shadows"].value("sun_threshold", 0.5f));
+        shadowSettings.stagger = config["shadows"].value("stagger", true);
         // close file
         configFile.close();
 
@@ -134,8 +177,8 @@ bool App::init() {
     if (!glfwInit()) {
         throw std::runtime_error("Failed to initialize GLFW");
     }
-    // request MSAA
-    if (AA) glfwWindowHint(GLFW_SAMPLES, AASamples);
+    // MSAA lives in the scene target, the window itself is single sampled
+    sceneTarget.setSamples(AA ? AASamples : 0);
 
     // Open GL Core Profile
     glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
@@ -206,11 +249,18 @@ bool App::init() {
 }
 
 void App::initAssets(void) {
+    jobs = new JobSystem(jobThreads);
+    std::cout << "Job system: " << jobs->workerCount() << " worker threads\n";
+    navigation.setJobSystem(jobs);
+    navigation.setSliceBudget(navSliceCells);
+    // headless runs must repeat exactly: fields switch on a fixed tick, not when a worker finishes
+    if (headless) navigation.setLockstep(true);
+
     /*
      * Terrain init
      */
     bool isTransparent = false;
-    shader = ShaderProgram("resources/shaders/tex.vert", "resources/shaders/tex.frag");
+    if (!headless) shader = ShaderProgram("resources/shaders/tex.vert", "resources/shaders/tex.frag");
     terrain = new Terrain{ shader };
     GLuint texture_terrain = textureInit("resources/textures/moon.png", isTransparent);
 
@@ -218,7 +268,10 @@ void App::initAssets(void) {
     for (auto& mesh : terrain->meshes) {
         mesh.texture_id = texture_terrain;
     }
+    // terrain tiles never move, culled one by one
+    culler.addStatic(*terrain);
     //terrain->getHeightOnMap(camera.position, 0.2f);
+    navigation.setGrid(std::make_shared<const NavGrid>(*terrain, navCellSize, navMaxSlope, navSlopeCost));
 
     //Model skybox("resources/objects/cube.obj", shader);  //  mesh  .obj
     //
@@ -248,10 +301,10 @@ void App::initAssets(void) {
         mesh.texture_id = texture;
     }
     std::string donutName = "donut";
-    scene.emplace(donutName, std::move(donut));
-    auto DonutBotModelPtr = &scene.at(donutName);
+    ModelHandle donutHandle = addModel(donutName, std::move(donut));
 
-    Entity donutEntity(initPos, DonutBotModelPtr);
+    Entity donutEntity(initPos);
+    donutEntity.modelHandle = donutHandle;
     donutEntity.behaviors.push_back(Behaviors::FlyUp());
     donutEntity.setSpeed(glm::vec3(0.0f, 0.0f, 0.0f));
     entities.emplace(donutName, std::move(donutEntity));
@@ -266,10 +319,10 @@ void App::initAssets(void) {
         mesh.texture_id = texture;
     }
     std::string starName = "star";
-    scene.emplace(starName, std::move(star));
-    auto StarBotModelPtr = &scene.at(starName);
+    ModelHandle starHandle = addModel(starName, std::move(star));
 
-    Entity StarEntity(initPos, StarBotModelPtr);
+    Entity StarEntity(initPos);
+    StarEntity.modelHandle = starHandle;
     StarEntity.behaviors.push_back(Behaviors::FlyUp());
     StarEntity.setSpeed(glm::vec3(0.0f, 0.0f, 0.0f));
     entities.emplace(starName, std::move(StarEntity));
@@ -286,14 +339,15 @@ void App::initAssets(void) {
         mesh.texture_id = texture;
     }
     std::string botName = "bot";
-    scene.emplace(botName, std::move(botModel));
-    auto botModelPtr = &scene.at("bot"); // store pointer for entity
+    ModelHandle botHandle = addModel(botName, std::move(botModel)); // store handle for entity
 
     auto cameraPtr = &camera;
-    Entity bot(initPos, botModelPtr, cameraPtr);
-    bot.behaviors.push_back(Behaviors::FollowCamera());
+    Entity bot(initPos, nullptr, cameraPtr);
+    bot.modelHandle = botHandle;
     bot.setSpeed(glm::vec3(0.3f, 0.0f, 0.0f));
     entities.emplace(botName, std::move(bot));
+    // map nodes are stable, the task can keep a reference to the entity
+    behaviorScheduler.spawn(Behaviors::FollowCameraTask(entities.at(botName), &navigation));
 
     Model botModel1("resources/objects/cube_star.obj", shader);
     initPos = glm::vec3{ 2.0f, 2.0f, -3.0f };
@@ -303,33 +357,175 @@ void App::initAssets(void) {
         mesh.texture_id = texture;
     }
     std::string botName1 = "bot1";
-    scene.emplace(botName1, std::move(botModel1));
-    auto botModelPtr1 = &scene.at("bot1"); // store pointer for entity
+    ModelHandle botHandle1 = addModel(botName1, std::move(botModel1)); // store handle for entity
 
-    Entity bot1(initPos, botModelPtr1);
+    Entity bot1(initPos);
+    bot1.modelHandle = botHandle1;
     bot1.behaviors.push_back(Behaviors::FlyUp());
     bot1.setSpeed(glm::vec3(0.0f, 0.0f, 0.0f));
     entities.emplace(botName1, std::move(bot1));
 
+    // register bots in the collision broadphase, consecutive LOD phases
+    // spread their reduced rate updates over ticks
+    resolveModels();
+    std::uint32_t simPhase = 0;
+    for (auto& [name, ent] : entities) {
+        addCollider(ent, CollisionLayer::Bot, CollisionLayer::All);
+        ent.simPhase = simPhase++;
+        // the transform node drives the model from now on
+        if (!ent.model) continue;
+        ent.transformNode = transforms.create(ent.position, ent.rotation, ent.model->scale,
+            TransformSystem::Null, ent.modelHandle.toBits());
+        transforms.setLocalBounds(ent.transformNode, ent.model->AABBMin, ent.model->AABBMax);
+    }
+    // a child node follows its parent without any per-frame code
+    carriedLight = transforms.create(glm::vec3(0.0f, 1.5f, 0.0f), glm::vec3(0.0f), glm::vec3(1.0f),
+        entities.at(botName).transformNode, ModelHandle().toBits());
+    syncTransforms();
+
+    // triangle BVHs for ray queries (picking, hit-scan), models build independently
+    std::vector<Model*> bvhModels{ terrain };
+    for (Model& model : scene) bvhModels.push_back(&model);
+    jobs->parallelFor(0, bvhModels.size(), 1, [&](std::size_t first, std::size_t last) {
+        for (std::size_t i = first; i < last; ++i) bvhModels[i]->buildBVH();
+    });
+
+    // single model shared by all projectiles
+    isTransparent = false;
+    GLuint projectileTexture = textureInit("resources/textures/tex_256.png", isTransparent);
+    projectileModel = new Model("resources/objects/cube_bullet.obj", shader);
+    projectileModel->transparent = isTransparent;
+    for (auto& mesh : projectileModel->meshes) {
+        mesh.texture_id = projectileTexture;
+    }
+    projectileModel->setScale(glm::vec3(0.1f));
+
+    // particles: GPU when compute shaders are available, CPU emitters otherwise
+    particlesOnGPU = particlesOnGPU && !headless && GLEW_ARB_compute_shader;
+    sparkEmitter = cpuParticles.addEmitter({ sparkCapacity });
+    impactEmitter = cpuParticles.addEmitter({ impactCapacity });
+    if (headless) return;
+    if (particlesOnGPU) gpuParticles.init(particleCapacity, terrain);
+    else particleShader = ShaderProgram("resources/shaders/particle.vert", "resources/shaders/particle.frag");
+
+    // Hi-Z occlusion culling of the instanced draws, needs compute shaders too
+    occlusionCulling = occlusionCulling && GLEW_ARB_compute_shader;
+    if (occlusionCulling) occlusion.init();
+    // otherwise coarse occluders rasterized on the CPU
+    softwareOcclusion = softwareOcclusion && !occlusionCulling;
+    if (softwareOcclusion) {
+        softOcclusion.setResolution(softwareOcclusionWidth, softwareOcclusionWidth * windowHeight / std::max(windowWidth, 1));
+        softOcclusion.setTerrain(*terrain);
+    }
 
-
-    // init particles shader
-    particleShader = ShaderProgram("resources/shaders/particle.vert", "resources/shaders/particle.frag");
+    // programs of the depth pre-pass and deferred paths, all are kept to switch at runtime
+    depthShader = ShaderProgram("resources/shaders/tex.vert", "resources/shaders/depth_only.frag");
+    deferred.init();
+    deferred.setViewport(windowWidth, windowHeight);
+    shadows.init(shadowSettings);
+    shadows.addStatic(*terrain);
 
     // initialize lights
     initLights();
 
 }
 
+// simulation only: same world and heightmap, no GLFW/GL initialization
+bool App::initHeadless() {
+    headless = true;
+    Mesh::uploadToGPU = false;
+    loadConfig();
+    // particles use rand(), fix the seed so runs are repeatable
+    std::srand(1);
+
+    camera.position = glm::vec3(0.0f, 4.0f, 3.0f);
+    try {
+        initAssets();
+        std::cout << "Headless world initialized\n";
+    }
+    catch (const std::exception& e) {
+        std::cerr << "Asset initialization failed: " << e.what() << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// run a fixed number of ticks as fast as possible, reports ticks per second
+int App::runHeadless(std::uint64_t ticks) {
+    const float dt = static_cast<float>(simClock.step);
+    auto start = std::chrono::steady_clock::now();
+    auto lastReport = start;
+    std::uint64_t lastTick = 0;
+
+    for (std::uint64_t tick = 1; tick <= ticks; ++tick) {
+        simulate(dt);
+
+        auto now = std::chrono::steady_clock::now();
+        double sinceReport = std::chrono::duration<double>(now - lastReport).count();
+        if (sinceReport >= 1.0) {
+            std::cout << "tick " << tick << ": " << static_cast<int>((tick - lastTick) / sinceReport) << " ticks/s\n";
+            lastReport = now;
+            lastTick = tick;
+        }
+    }
+
+    double total = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "Simulated " << ticks << " ticks (" << ticks * simClock.step << " s) in " << total << " s, "
+        << static_cast<int>(ticks / std::max(total, 1e-9)) << " ticks/s, "
+        << entities.size() << " entities, " << projectileSystem.size() << " projectiles\n";
+    return EXIT_SUCCESS;
+}
+
 void App::updateProjection() {
     float aspect = static_cast<float>(windowWidth) / windowHeight;
     projectionMatrix = glm::perspective(
-        glm::radians(fov), aspect, 0.1f, 100.0f
+        glm::radians(fov), aspect, nearPlane, farPlane
     );
+    lightClusters.setProjection(projectionMatrix, nearPlane, farPlane, windowWidth, windowHeight,
+        clusterTileSize, clusterSlices);
+    occlusion.setViewport(windowWidth, windowHeight);
+    deferred.setViewport(windowWidth, windowHeight);
+    sceneTarget.setViewport(windowWidth, windowHeight);
+}
+
+// opaque pass from the instanced commands of this frame; overdraw costs the
+// full lighting only on the forward path
+void App::drawOpaque() {
+    OcclusionCuller* occluder = occlusionCulling ? &occlusion : nullptr;
+    switch (renderPath) {
+    case RenderPath::Forward:
+        instancer.flush(projectionMatrix, viewMatrix, camera.position, occluder);
+        break;
+    case RenderPath::DepthPrepass: {
+        // depth first, then every pixel is shaded once by the nearest surface
+        GLint depthFunc = GL_LEQUAL;
+        glGetIntegerv(GL_DEPTH_FUNC, &depthFunc);
+        glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+        instancer.flush(projectionMatrix, viewMatrix, camera.position, occluder, &depthShader);
+        glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+        glDepthFunc(GL_EQUAL);
+        glDepthMask(GL_FALSE);
+        instancer.redraw(projectionMatrix, viewMatrix, camera.position);
+        glDepthFunc(depthFunc);
+        glDepthMask(GL_TRUE);
+        break;
+    }
+    case RenderPath::Deferred:
+        // the Hi-Z pyramid is built from the G-buffer depth on this path
+        deferred.beginGeometry();
+        occlusion.setDepthSource(deferred.getFramebuffer());
+        instancer.flush(projectionMatrix, viewMatrix, camera.position, occluder, &deferred.getGeometryProgram());
+        occlusion.setDepthSource(sceneTarget.getFramebuffer());
+        deferred.endGeometry(sceneTarget.getFramebuffer());
+        deferred.shade(projectionMatrix, viewMatrix, camera.position,
+            lights.pointLights.size(), lights.spotLights.size());
+        break;
+    }
 }
 
 GLuint App::textureInit(const std::filesystem::path& file_name, bool& isTransparent)
 {
+    if (headless) return 0; // no texture, isTransparent is left as requested
     cv::Mat image = cv::imread(file_name.string(), cv::IMREAD_UNCHANGED);  // Read with (potential) Alpha
     if (image.empty()) {
         throw std::runtime_error("No texture in file: " + file_name.string());
@@ -446,74 +642,287 @@ void App::initLights() {
     // ambient light
     lights.initAmbientLight(glm::vec3(0.0f));
 
+    // projectile lights are appended after these every tick
+    sceneLightCount = lights.pointLights.size();
+
 
 }
 
 void App::applyLights()
 {
-    // Ambient Light
-    lights.ambientLight.apply(shader, 0);
+    // only the lights that changed since the last frame are uploaded
+    lightBuffer.upload(lights);
+    lightBuffer.bind();
+
+    // per cluster light lists for the current view, built on the job workers
+    lightClusters.build(lights, viewMatrix, *jobs);
+    lightClusters.upload();
+    lightClusters.bind();
+}
 
-    // Directional light
-    lights.sun.apply(shader, 0);
 
-    // Spotlights
-    int spotIndex = 0;
-    for (const auto& spot : lights.spotLights)
-        spot.apply(shader, spotIndex++);
 
-    // glProgramUniform1i(shaderID, numSpotLoc, spotIndex);
-    shader.setUniform("numSpotLights", spotIndex);
+void App::shootProjectile() {
+    glm::vec3 start = camera.position;
+    glm::vec3 direction = glm::normalize(camera.front);
+    glm::vec3 spawnPos = (start + direction);
 
+    // silently dropped when every round of the pool is in flight
+    projectileSystem.spawn(spawnPos, direction * projectileSpeed);
+}
 
-    // Point lights
-    int pointIndex = 0;
-    for (const auto& point : lights.pointLights)
-        point.apply(shader, pointIndex++);
+// closest hit over the scene models and the terrain, ray.direction need not be normalized
+bool App::raycastScene(const Ray& ray, RayHit& hit, Model*& model) {
+    model = nullptr;
+    for (Model& m : scene) {
+        if (m.raycast(ray, hit)) model = &m;
+    }
+    if (terrain && terrain->raycast(ray, hit)) model = terrain;
+    return model != nullptr;
+}
 
-    // glProgramUniform1i(shaderID, numPointLoc, pointIndex);
-    shader.setUniform("numPointLights", pointIndex);
+// packet version, models[i] stays nullptr for rays that hit nothing
+void App::raycastScene(const Ray* rays, RayHit* hits, Model** models, int count) {
+    for (int r = 0; r < count; ++r) models[r] = nullptr;
+    auto trace = [&](Model& m) {
+        std::uint64_t updated = m.raycast(rays, hits, count);
+        for (int r = 0; r < count; ++r) {
+            if (updated & (1ull << r)) models[r] = &m;
+        }
+    };
+    for (Model& m : scene) trace(m);
+    if (terrain) trace(*terrain);
 }
 
+ModelHandle App::addModel(const std::string& name, Model&& model) {
+    ModelHandle handle = scene.insert(std::move(model));
+    sceneIndex[name] = handle;
+    return handle;
+}
 
+// nullptr for unknown names and erased models
+Model* App::findModel(const std::string& name) {
+    auto it = sceneIndex.find(name);
+    return it == sceneIndex.end() ? nullptr : scene.get(it->second);
+}
 
-void App::shootProjectile() {
-    bool isTransparent = false;
-    glm::vec3 start = camera.position;
-    glm::vec3 direction = glm::normalize(camera.front);
-    glm::vec3 spawnPos = (start + direction);
-    GLuint texture = textureInit("resources/textures/tex_256.png", isTransparent);
+// recompute changed transforms and copy the results into their models
+void App::syncTransforms() {
+    transforms.update();
+    for (TransformSystem::Node node : transforms.getChanged()) {
+        Model* model = scene.get(ModelHandle::fromBits(transforms.getUserData(node)));
+        if (model) model->setWorldTransform(transforms.getWorldMatrix(node), transforms.getWorldBounds(node).min, transforms.getWorldBounds(node).max);
+    }
+    if (carriedLight != TransformSystem::Null && sceneLightCount > 0) {
+        lights.pointLights[sceneLightCount - 1].position = transforms.getWorldPosition(carriedLight);
+    }
+}
 
-    Model projectileModel("resources/objects/cube_bullet.obj", shader);
-    projectileModel.transparent = isTransparent;
-    for (auto& mesh : projectileModel.meshes) {
-        mesh.texture_id = texture;
+// refresh cached Model pointers, inserting or erasing models moves them
+void App::resolveModels() {
+    for (auto& [name, ent] : entities) {
+        if (!ent.modelHandle.isNull()) ent.model = scene.get(ent.modelHandle);
+    }
+}
+
+Entity* App::findEntity(const Model* model) {
+    for (auto& [name, ent] : entities) {
+        if (ent.model == model) return &ent;
+    }
+    return nullptr;
+}
+
+// the GPU path has no emitter split and spawns many more particles per request
+void App::spawnParticles(ParticleSystem::Emitter emitter, const glm::vec3& origin, int count) {
+    if (particlesOnGPU) gpuParticles.emit(origin, count * particleEmitScale);
+    else cpuParticles.spawn(emitter, origin, count);
+}
+
+// report what is under the crosshair in the window title
+void App::pick() {
+    Ray ray{ camera.position, glm::normalize(camera.front) };
+    RayHit hit;
+    Model* model = nullptr;
+    if (!raycastScene(ray, hit, model)) {
+        picked = "nothing";
+        return;
+    }
+    picked = model == terrain ? "terrain" : "?";
+    for (auto& [n, handle] : sceneIndex) {
+        if (scene.get(handle) == model) picked = n;
+    }
+    glm::vec3 point = ray.origin + ray.direction * hit.t;
+    spawnParticles(impactEmitter, point, 5);
+}
+
+// spread of instant rays around the view direction
+void App::hitScan() {
+    glm::vec3 forward = glm::normalize(camera.front);
+    glm::vec3 right = glm::normalize(glm::cross(forward, camera.up));
+    glm::vec3 up = glm::cross(right, forward);
+
+    int count = std::clamp(hitScanRays, 1, BVH::MaxPacket);
+    Ray rays[BVH::MaxPacket];
+    RayHit hits[BVH::MaxPacket];
+    Model* models[BVH::MaxPacket];
+    for (int r = 0; r < count; ++r) {
+        // center ray plus a ring
+        float angle = glm::radians(360.0f) * r / std::max(1, count - 1);
+        float spread = r == 0 ? 0.0f : hitScanSpread;
+        glm::vec3 dir = forward + (right * std::cos(angle) + up * std::sin(angle)) * spread;
+        rays[r] = Ray{ camera.position, glm::normalize(dir) };
+        hits[r] = RayHit();
+    }
+    raycastScene(rays, hits, models, count);
+
+    for (int r = 0; r < count; ++r) {
+        if (!models[r]) continue;
+        glm::vec3 point = rays[r].origin + rays[r].direction * hits[r].t;
+        spawnParticles(impactEmitter, point, 3);
+        if (Entity* ent = findEntity(models[r])) {
+            ent->applyImpulse(rays[r].direction * projectileSystem.impulse);
+        }
+    }
+}
+
+void App::simulate(float dt) {
+    // --- ENTITY & PARTICLE LOGIC ---
+    resolveModels();
+    navigation.setGoals({ camera.position });
+    navigation.update();
+    behaviorScheduler.update(dt);
+    float groundHeight = 0.0f; // You could sample from terrain here if desired
+    simLOD.beginTick(camera.position, camera.front);
+    dueEntities.clear();
+    for (auto& [name, ent] : entities) {
+        // distant and off-screen entities skip ticks and catch up with a longer dt
+        if (!simLOD.isDue(simLOD.bandOf(ent.position), ent.simPhase)) continue;
+        ent.simInterval = static_cast<int>(simLOD.getTick() - ent.lastSimTick);
+        ent.lastSimTick = simLOD.getTick();
+        dueEntities.push_back(&ent);
     }
-    projectileModel.setScale(glm::vec3(0.1f));
-    projectileModel.setPos(spawnPos);
-    std::ostringstream oss;
-    oss << "projectile_" << glfwGetTime();
-    scene.emplace(oss.str(), std::move(projectileModel));
-    auto projectileModelPtr = &scene.at(oss.str()); // store pointer for entity
 
+    // entities only touch their own state and model, terrain is read only
+    jobs->parallelFor(0, dueEntities.size(), 64, [&](std::size_t first, std::size_t last) {
+        for (std::size_t i = first; i < last; ++i) {
+            Entity& ent = *dueEntities[i];
+            ent.storePreviousState();
+            glm::vec3 entityPosition = ent.position;
+            terrain->getHeightOnMap(entityPosition, ent.model ? ent.model->getHeight() / 2.0f : 0.0f);
+            ent.update(dt * ent.simInterval, entityPosition.y);
+        }
+    });
 
-    Entity projectileEntity(spawnPos, projectileModelPtr);
+    // only entities that moved dirty their transform nodes
+    for (Entity* ent : dueEntities) ent->syncTransform(transforms);
+    syncTransforms();
 
-    projectileEntity.setGravity(0);
-    projectileEntity.setSpeed(direction * 0.5f);
-    projectiles.emplace(oss.str(), std::move(projectileEntity));
+    for (Entity* ent : dueEntities) {
+        //std::cout << "Bot position: " << ent->position.x << ", " << ent->position.y << ", " << ent->position.z << std::endl;
 
+        // Example: spawn sparks at bot position every time it passes a certain y threshold
+        if (ent->position.y > 5.5f) {
+            spawnParticles(sparkEmitter, ent->position, 10);
+        }
+    }
+    // both particle paths step with the simulation tick, not the frame time
+    if (particlesOnGPU) gpuParticles.update(dt);
+    else cpuParticles.update(dt);
 
-    /* Entity projectile(spawnPos);
-     projectile.setGravity(0);
-     projectile.setSpeed(direction);
-     projectile.model = new Model("resources/objects/cube_lava.obj", shader);
+    /*
+     *  --- COLLISIONS ---
+     */
+
+    // refit moved proxies, then let the tree report overlapping pairs
+    for (auto& [name, ent] : entities) updateCollider(ent);
+    broadphase.computePairs(collisionPairs);
 
+    for (const auto& pair : collisionPairs) {
+        Entity* entA = reinterpret_cast<Entity*>(pair.userA);
+        Entity* entB = reinterpret_cast<Entity*>(pair.userB);
 
+        // narrowphase: exact test of the oriented boxes, rotated models often
+        // overlap in their loose world AABBs only
+        Contact contact;
+        if (!Narrowphase::intersect(entA->getOBB(), entB->getOBB(), contact)) continue;
 
-     Particles::spawn(spawnPos, 10);
+        spawnParticles(impactEmitter, entA->position, 5);
+        spawnParticles(impactEmitter, entB->position, 5);
+
+        // separate along the contact normal, split between the bodies that respond
+        bool movesA = entA->collisionLayer & CollisionLayer::Bot;
+        bool movesB = entB->collisionLayer & CollisionLayer::Bot;
+        float share = (movesA && movesB) ? 0.5f : 1.0f;
+        if (movesA) entA->resolveContact(-contact.normal, contact.depth * share);
+        if (movesB) entB->resolveContact(contact.normal, contact.depth * share);
+    }
 
-     projectiles[oss.str()] = projectile;*/
+    /*
+     *  --- PROJECTILES ---
+     */
+
+    // automatic fire while the trigger is held
+    fireCooldown = std::max(0.0f, fireCooldown - dt);
+    while (triggerHeld && fireCooldown <= 0.0f) {
+        shootProjectile();
+        fireCooldown += 1.0f / fireRate;
+    }
+
+    // swept against the broadphase and the terrain, so fast rounds cannot tunnel
+    projectileSystem.update(dt, broadphase, terrain, projectileHits);
+    for (const auto& hit : projectileHits) {
+        spawnParticles(impactEmitter, hit.position, 5);
+        if (hit.terrain) continue;
+        Entity* target = reinterpret_cast<Entity*>(hit.target);
+        // knock the target away from the face that was hit
+        if (target->collisionLayer & CollisionLayer::Bot) target->applyImpulse(-hit.normal * projectileSystem.impulse);
+    }
+
+    // every round in flight carries a short range light after the scene lights,
+    // clustering keeps the shading cost per fragment independent of their number.
+    // A round keeps its light slot for its whole life, free slots below the
+    // highest one in use are dark (zero range, skipped by the clustering)
+    static const PointLight roundLight(glm::vec3(0.0f), glm::vec3(0.0f), glm::vec3(1.0f, 0.6f, 0.2f),
+        glm::vec3(0.5f, 0.3f, 0.1f), 1.0f, 0.7f, 1.8f);
+    static const PointLight darkLight(glm::vec3(0.0f), glm::vec3(0.0f), glm::vec3(0.0f),
+        glm::vec3(0.0f), 1.0f, 0.0f, 0.0f);
+    std::size_t usedSlots = 0;
+    for (std::size_t i = 0; i < projectileSystem.size(); ++i) {
+        std::uint32_t slot = projectileSystem.getLight(i);
+        if (slot != ProjectileSystem::NoLight) usedSlots = std::max<std::size_t>(usedSlots, slot + 1);
+    }
+    lights.pointLights.resize(sceneLightCount + usedSlots, darkLight);
+    std::fill(lights.pointLights.begin() + sceneLightCount, lights.pointLights.end(), darkLight);
+    for (std::size_t i = 0; i < projectileSystem.size(); ++i) {
+        std::uint32_t slot = projectileSystem.getLight(i);
+        if (slot == ProjectileSystem::NoLight) continue;
+        PointLight& light = lights.pointLights[sceneLightCount + slot];
+        light = roundLight;
+        light.position = projectileSystem.getPosition(i);
+    }
+}
+
+void App::addCollider(Entity& ent, std::uint32_t layer, std::uint32_t mask) {
+    if (!ent.model) return;
+    ent.collisionLayer = layer;
+    ent.broadphaseProxy = broadphase.createProxy(ent.getBounds(), reinterpret_cast<std::uintptr_t>(&ent), layer, mask);
+}
+
+void App::updateCollider(Entity& ent) {
+    if (ent.broadphaseProxy == DynamicAABBTree::NullNode || !ent.model) return;
+    // simulated state, the model may still hold an interpolated pose
+    broadphase.moveProxy(ent.broadphaseProxy, ent.getBounds(), ent.position - ent.previousPosition);
+}
+
+void App::interpolateTransforms(float alpha) {
+    for (auto& [name, ent] : entities) {
+        // reduced rate entities are interpolated over their whole update interval
+        float ticksSince = static_cast<float>(simLOD.getTick() - ent.lastSimTick);
+        float entityAlpha = std::min(1.0f, (ticksSince + alpha) / ent.simInterval);
+        ent.interpolateModel(entityAlpha);
+        ent.syncTransform(transforms, entityAlpha);
+    }
+    syncTransforms();
 }
 
 int App::run() {
@@ -544,6 +953,9 @@ int App::run() {
         deltaTime = currentFrameTime - lastFrameTime;
         lastFrameTime = currentFrameTime;
 
+        // trigger state is sampled per frame, rounds are fired on simulation ticks
+        triggerHeld = glfwGetMouseButton(window, GLFW_MOUSE_BUTTON_LEFT) == GLFW_PRESS;
+
         // Process camera movement
         glm::vec3 moveOffset = camera.ProcessInput(window, deltaTime);
         camera.position += moveOffset;
@@ -551,83 +963,27 @@ int App::run() {
         // Update view matrix from camera
         viewMatrix = camera.GetViewMatrix();
 
-        // Clear buffers
+        // Clear buffers, the scene is drawn into its own framebuffer
+        sceneTarget.bind();
+        occlusion.setDepthSource(sceneTarget.getFramebuffer());
         glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-        // --- ENTITY & PARTICLE LOGIC ---
-        float groundHeight = 0.0f; // You could sample from terrain here if desired
-        for (auto& [name, ent] : entities) {
-            glm::vec3 entityPosition = ent.position;
-            terrain->getHeightOnMap(entityPosition, ent.model->getHeight() / 2.0f);
-            ent.update(static_cast<float>(deltaTime), entityPosition.y);
-            //std::cout << "Bot position: " << ent.position.x << ", " << ent.position.y << ", " << ent.position.z << std::endl;
-
-            // Example: spawn sparks at bot position every time it passes a certain y threshold
-            if (ent.position.y > 5.5f) {
-                Particles::spawn(ent.position, 10);
-            }
-
-        }
-        Particles::update(static_cast<float>(deltaTime));
-
         /*
-         *  --- COLLISIONS ---
+         *  --- FIXED-STEP SIMULATION ---
          */
-
-        for (auto it1 = scene.begin(); it1 != scene.end(); ++it1) {
-            for (auto it2 = std::next(it1); it2 != scene.end(); ++it2) {
-                if (it1->second.name == "Terrain" || it2->second.name == "Terrain") { continue; }
-                auto minA = it1->second.getAABBMin();
-                auto maxA = it1->second.getAABBMax();
-                auto minB = it2->second.getAABBMin();
-                auto maxB = it2->second.getAABBMax();
-
-                if (AABBintersect(minA, maxA, minB, maxB)) {
-                    std::cout << "Collision detected between "
-                        << it1->first << " and " << it2->first << std::endl;
-                    Particles::spawn(it1->second.origin, 5);
-                    Particles::spawn(it2->second.origin, 5);
-                    auto ent1 = entities.find(it1->first);
-                    auto ent2 = entities.find(it2->first);
-                    if (ent1 != entities.end()) ent1->second.reverseSpeedXZ();
-                    if (ent2 != entities.end()) ent2->second.reverseSpeedXZ();
-                }
-            }
-        }
-
-        for (auto it = projectiles.begin(); it != projectiles.end(); ) {
-            Entity& e = it->second;
-            e.update(static_cast<float>(deltaTime), 0.0f);
-
-            int index = 0;
-            for (auto& [key, e] : projectiles) {
-                e.update(deltaTime, 0.0f);
-
-                if (index < lights.pointLights.size()) {
-                    lights.pointLights[index].position = e.position;
-                    ++index;
-                }
-            }
-
-            // Delete cube
-            if (glm::length(e.position - camera.position) > 10.0f) {
-                scene.erase(scene.find(it->first));
-                it = projectiles.erase(it);
-            }
-            else {
-                ++it;
-            }
+        int steps = simClock.advance(deltaTime);
+        for (int i = 0; i < steps; ++i) {
+            simulate(static_cast<float>(simClock.step));
         }
+        // place models between the last two ticks for smooth rendering
+        interpolateTransforms(simClock.alpha());
 
 
         /*
          *  --- SCENE RENDERING ---
          */
 
-        std::vector<Model*> transparent;    // temporary, vector of pointers to transparent objects
-        transparent.reserve(scene.size());  // reserve size for all objects to avoid reallocation
-
         double time = glfwGetTime();
         float sunAngle = float(time) * 0.2f;
         float daylight = glm::clamp(sin(sunAngle), 0.0f, 1.0f);
@@ -662,30 +1018,70 @@ int App::run() {
         // Pass lights to the main shader
         applyLights();
 
-        terrain->draw(projectionMatrix, viewMatrix, camera.position);
-        // Draw all models in the scene
-        for (auto& [name, model] : scene) {
+        // visible set of this view: models refitted in the culling BVH, then
+        // the tree is walked with the frustum planes
+        glm::mat4 viewProjection = projectionMatrix * viewMatrix;
+        culler.sync(scene);
+        if (softwareOcclusion) {
+            // coarse terrain plus large opaque models, rasterized on the job workers
+            softOcclusion.beginFrame();
+            for (Model& model : scene) {
+                if (model.transparent) continue;
+                glm::vec3 size = model.getAABBMax() - model.getAABBMin();
+                if (std::max({ size.x, size.y, size.z }) >= occluderMinSize) softOcclusion.addOccluder(model);
+            }
+            softOcclusion.render(viewProjection, *jobs);
+        }
+        culler.cull(viewProjection, scene, softwareOcclusion ? &softOcclusion : nullptr);
+
+        // visible terrain tiles and opaque models come from the geometry pool,
+        // grouped by mesh into instanced commands of a few multi-draw calls
+        instancer.begin();
+        for (Mesh* tile : culler.visibleMeshes) instancer.add(*tile, terrain->modelMatrix);
+        transparentQueue.clear();
+        for (Model* visible : culler.visibleModels) {
+            Model& model = *visible;
             if (!model.transparent) {
-                model.draw(projectionMatrix, viewMatrix, camera.position);
+                instancer.add(model);
+                continue;
+            }
+            // painter's algorithm: keyed far to near by squared distance, no sqrt
+            model.updateAABBAndModelMatrix();
+            // world box center: also right for models placed by a transform node
+            glm::vec3 toModel = (model.getAABBMin() + model.getAABBMax()) * 0.5f - camera.position;
+            float depth = glm::dot(toModel, toModel);
+            for (Mesh& mesh : model.meshes) {
+                transparentQueue.add(RenderQueue::transparentKey(depth, mesh.shader.getID(), mesh.texture_id),
+                    mesh, model.modelMatrix);
             }
-            else
-                transparent.emplace_back(&model); // save pointer for painters algorithm
         }
-        // THIRD PART - draw only transparent - painter's algorithm (sort by distance from camera, from far to near)
-        std::sort(transparent.begin(), transparent.end(), [&](Model const* a, Model const* b) {
-            return glm::distance(camera.position, a->origin) > glm::distance(camera.position, b->origin); // sort by distance from camera
-            });
+        // projectiles share one model, one instance per round
+        float alpha = simClock.alpha();
+        for (std::size_t i = 0; i < projectileSystem.size(); ++i) {
+            projectileModel->setPos(projectileSystem.getRenderPosition(i, alpha));
+            if (!culler.visible(AABB(projectileModel->getAABBMin(), projectileModel->getAABBMax()))) continue;
+            instancer.add(*projectileModel);
+        }
+        // sun shadows: cascades due this frame, terrain depth from the cache
+        shadows.update(viewMatrix, glm::radians(fov), static_cast<float>(windowWidth) / windowHeight, nearPlane,
+            lights.sun.direction, scene);
+        // drawn in two phases around a Hi-Z rebuild, occluded instances never reach the vertex shader
+        drawOpaque();
+        // THIRD PART - draw only transparent, radix sorted, redundant binds skipped
         glEnable(GL_BLEND);
         glDepthMask(GL_FALSE);
-        for (auto p : transparent) {
-            p->draw(projectionMatrix, viewMatrix, camera.position);
-        }
+        transparentQueue.submit(projectionMatrix, viewMatrix, camera.position);
         glDisable(GL_BLEND);
         glDepthMask(GL_TRUE);
 
         // --- PARTICLE RENDERING ---
-        // Use a simple shader for particles, or reuse one of your shaders
-        Particles::drawParticles(projectionMatrix, viewMatrix, particleShader);
+        // simulated on the tick, depth sorted and drawn on the GPU with counts it wrote itself
+        glEnable(GL_BLEND);
+        glDepthMask(GL_FALSE);
+        if (particlesOnGPU) gpuParticles.draw(projectionMatrix, viewMatrix, sceneTarget.getFramebuffer(), windowWidth, windowHeight);
+        else cpuParticles.draw(projectionMatrix, viewMatrix, particleShader);
+        glDisable(GL_BLEND);
+        glDepthMask(GL_TRUE);
 
         // FPS calculation
         frameCount++;
@@ -695,13 +1091,27 @@ int App::run() {
         if (elapsed >= 1.0) {
             int fps = static_cast<int>(frameCount / elapsed);
             // show title + fps + vsync status
-            std::string title = windowTitle + " [FPS: " + std::to_string(fps) + "], VSYNC: " + (vsync ? "ON" : "OFF") + ", AA: " + (AA ? "ON" : "OFF");
+            std::string title = windowTitle + " [FPS: " + std::to_string(fps) + "], VSYNC: " + (vsync ? "ON" : "OFF") + ", AA: " + (AA ? "ON" : "OFF")
+                + ", SIM: " + std::to_string(static_cast<int>(simClock.tickRate())) + " Hz";
+            // simulated/total entities per LOD band in the last tick
+            title += ", LOD:";
+            for (const auto& band : simLOD.getStats()) {
+                title += " " + std::to_string(band.simulated) + "/" + std::to_string(band.entities);
+            }
+            title += ", CULL: " + std::to_string(culler.stats.visible) + " visible, " + std::to_string(culler.stats.culled) + " culled ("
+                + std::to_string(culler.stats.occluded) + " occluded)";
+            const char* pathNames[] = { "forward", "prepass", "deferred" };
+            title += ", PATH: " + std::string(pathNames[static_cast<int>(renderPath)]);
+            title += ", SHADOW: " + std::to_string(shadows.stats.cascades) + " cascades ("
+                + std::to_string(shadows.stats.statics) + " static)";
+            title += ", PICK: " + picked;
             glfwSetWindowTitle(window, title.c_str());
 
             frameCount = 0;
             lastTime = current_time;
         }
 
+        sceneTarget.present();    // resolve into the window
         glfwSwapBuffers(window);  // Update window content
         glfwPollEvents();         // Process pending events
 
@@ -744,10 +1154,25 @@ void App::toggleFullscreen() {
 }
 
 App::~App() {
+    // stop workers before the data they may reference goes away
+    delete jobs;
+
     // cleanup models and shaders
     scene.clear();
     shader.clear();
+    gpuParticles.clear();
+    instancer.clear();
+    occlusion.clear();
+    depthShader.clear();
+    deferred.clear();
+    sceneTarget.clear();
+    shadows.clear();
+    cpuParticles.clear();
+    particleShader.clear();
+    lightBuffer.clear();
+    lightClusters.clear();
     delete terrain;
+    delete projectileModel;
 
     if (window) {
         glfwDestroyWindow(window);
@@ -758,15 +1183,12 @@ App::~App() {
 
 // ----- callbacks ------
 void App::mouse_clicked_callback(GLFWwindow* window, int button, int action, int mods) {
-    if (button == GLFW_MOUSE_BUTTON_LEFT && action == GLFW_PRESS) {
-        App* app = static_cast<App*>(glfwGetWindowUserPointer(window));
-        if (app) app->shootProjectile();
-    }
+    // left button (hold) is automatic fire, polled in run()
+    if (action != GLFW_PRESS) return;
     App* app = static_cast<App*>(glfwGetWindowUserPointer(window));
-    if (button == GLFW_MOUSE_BUTTON_RIGHT && action == GLFW_PRESS) {
-        App* app = static_cast<App*>(glfwGetWindowUserPointer(window));
-        if (app) app->shootProjectile();
-    }
+    if (!app) return;
+    if (button == GLFW_MOUSE_BUTTON_RIGHT) app->hitScan();
+    else if (button == GLFW_MOUSE_BUTTON_MIDDLE) app->pick();
 }
 
 void App::key_callback(GLFWwindow* window, int key, int scancode, int action, int mods) {
@@ -784,6 +1206,12 @@ void App::key_callback(GLFWwindow* window, int key, int scancode, int action, in
         case GLFW_KEY_F11:
             app->toggleFullscreen();
             break;
+        case GLFW_KEY_F3:
+            // forward -> depth pre-pass -> deferred
+            if (action == GLFW_PRESS) {
+                app->renderPath = static_cast<RenderPath>((static_cast<int>(app->renderPath) + 1) % 3);
+            }
+            break;
         case GLFW_KEY_P:
             if (!app->AA) {
                 glEnable(GL_MULTISAMPLE);
@@ -793,6 +1221,7 @@ void App::key_callback(GLFWwindow* window, int key, int scancode, int action, in
                 glDisable(GL_MULTISAMPLE);
                 app->AA = false;
             };
+            app->sceneTarget.setSamples(app->AA ? app->AASamples : 0);
             break;
         default:
             break;
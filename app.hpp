@@ -41,9 +41,25 @@
 #include "Mesh.hpp"
 // #include "camera.hpp"
 #include "Lights.hpp"
+#include "LightClusters.hpp"
 #include "Entity.hpp"
 #include "Behavior.hpp"
 #include "Particles.hpp"
+#include "GPUParticles.hpp"
+#include "InstancedRenderer.hpp"
+#include "RenderQueue.hpp"
+#include "Culling.hpp"
+#include "OcclusionCulling.hpp"
+#include "DeferredRenderer.hpp"
+#include "SceneTarget.hpp"
+#include "CascadedShadows.hpp"
+#include "FixedTimestep.hpp"
+#include "AABBTree.hpp"
+#include "Projectiles.hpp"
+#include "BehaviorTask.hpp"
+#include "FlowField.hpp"
+#include "SimulationLOD.hpp"
+#include "JobSystem.hpp"
 
 // callbacks
 #include "gl_err_callback.h"
@@ -57,16 +73,38 @@ public:
 
     // lights struct
     Lights lights;
+    LightBuffer lightBuffer;   // GPU copy of lights, shared by every shader
+    LightClusters lightClusters;   // per cluster light lists for tex.frag
+    std::size_t sceneLightCount = 0;       // point lights from the scene file, projectile lights follow
+    int clusterTileSize = 64;      // pixels
+    int clusterSlices = 24;
 
     App();
     bool init();
     int run();
+    bool initHeadless();
+    int runHeadless(std::uint64_t ticks);
+    void simulate(float dt);
+    void interpolateTransforms(float alpha);
+    void addCollider(Entity& ent, std::uint32_t layer, std::uint32_t mask);
+    void updateCollider(Entity& ent);
     void shootProjectile();
+    bool raycastScene(const Ray& ray, RayHit& hit, Model*& model);
+    void raycastScene(const Ray* rays, RayHit* hits, Model** models, int count);
+    Entity* findEntity(const Model* model);
+    ModelHandle addModel(const std::string& name, Model&& model);
+    Model* findModel(const std::string& name);
+    void resolveModels();
+    void syncTransforms();
+    void pick();
+    void hitScan();
+    void spawnParticles(ParticleSystem::Emitter emitter, const glm::vec3& origin, int count);
     void initAssets();
     GLuint textureInit(const std::filesystem::path& file_name, bool& isTransparent);
     GLuint gen_tex(cv::Mat& image, bool& isTransparent);
     void initLights();
     void updateProjection();
+    void drawOpaque();
     void toggleFullscreen();
 
     static void mouse_clicked_callback(GLFWwindow* window, int button, int action, int mods);
@@ -77,19 +115,90 @@ public:
     ~App();
 
 protected:
-    // all objects of the scene addressable by name  
-    std::unordered_map<std::string, Model> scene;
+    // all objects of the scene, densely packed; names are an optional side index
+    SlotMap<Model> scene;
+    std::unordered_map<std::string, ModelHandle> sceneIndex;
+    std::string picked = "-";   // last model under the crosshair, shown in the title
     Terrain *terrain;
     ShaderProgram shader;
-    ShaderProgram particleShader;
+    // terrain, opaque models and projectiles, multi-draw-indirect from one geometry pool
+    InstancedRenderer instancer;
+    // transparent meshes, sorted back to front by radix sorted keys
+    RenderQueue transparentQueue;
+    // view frustum culling over a BVH of model and terrain tile bounds
+    SceneCuller culler;
+    // GPU occlusion culling of the instanced draws against a Hi-Z pyramid
+    OcclusionCuller occlusion;
+    bool occlusionCulling = true;  // requested in the config, checked against the context
+    // CPU occlusion culling against rasterized coarse occluders, when the GPU path is off
+    SoftwareOcclusion softOcclusion;
+    bool softwareOcclusion = true;
+    int softwareOcclusionWidth = 256;  // depth buffer pixels, height follows the aspect
+    float occluderMinSize = 2.0f;      // models at least this large occlude
+    // shading of the opaque pass, switched at runtime with F3
+    enum class RenderPath { Forward, DepthPrepass, Deferred };
+    RenderPath renderPath = RenderPath::Forward;
+    ShaderProgram depthShader;         // depth pre-pass, no colour output
+    DeferredRenderer deferred;         // G-buffer and light volumes
+    SceneTarget sceneTarget;           // colour and 32F depth of the frame, MSAA when on
+    // sun shadows, terrain cached per cascade and far cascades staggered
+    CascadedShadows shadows;
+    CascadedShadows::Settings shadowSettings;
     // entities
     std::unordered_map<std::string, Entity> entities;
-    std::unordered_map<std::string, Entity> projectiles;
+    // pooled projectiles, drawn with one shared model
+    ProjectileSystem projectileSystem;
+    std::vector<ProjectileHit> projectileHits;
+    Model* projectileModel = nullptr;
+    float projectileSpeed = 20.0f;
+    float fireRate = 20.0f;      // rounds per second while the trigger is held
+    float fireCooldown = 0.0f;
+    bool triggerHeld = false;
+    // instant hit spread shot, traced as one ray packet
+    int hitScanRays = 8;
+    float hitScanSpread = 0.03f; // radians
+    // sparks simulated and drawn on the GPU, or on the CPU without compute
+    // shaders and in headless runs
+    GPUParticleSystem gpuParticles;
+    ParticleSystem cpuParticles;
+    ParticleSystem::Emitter sparkEmitter = 0, impactEmitter = 0;
+    ShaderProgram particleShader;
+    bool particlesOnGPU = true;  // requested in the config, checked against the context
+    std::uint32_t particleCapacity = 1 << 20;
+    int particleEmitScale = 20;  // GPU particles per requested spark
+    std::size_t sparkCapacity = 1024;
+    std::size_t impactCapacity = 2048;
+    // worker threads for simulation and asset work, 0 = one per core
+    JobSystem* jobs = nullptr;
+    unsigned jobThreads = 0;
+    std::vector<Entity*> dueEntities;  // entities simulated in the current tick
+    // terrain navigation, one flow field toward the camera shared by all followers
+    FlowFieldPlanner navigation;
+    float navCellSize = 0.25f;
+    float navMaxSlope = 1.5f;
+    float navSlopeCost = 4.0f;
+    std::size_t navSliceCells = 16384;  // flow field cells integrated per tick
+    // coroutine behaviors, resumed only when due
+    BehaviorScheduler behaviorScheduler;
+    // entity model placement (and anything attached to it), updated only when changed
+    TransformSystem transforms;
+    TransformSystem::Node carriedLight = TransformSystem::Null; // point light riding on the bot
+    // distance bands for reduced rate entity updates
+    SimulationLOD simLOD;
+    // no window, GL context or GPU resources, simulation only
+    bool headless = false;
+    // fixed-rate simulation clock, decoupled from the render rate
+    FixedTimestep simClock;
+    // collision broadphase over entity AABBs, user data is Entity*
+    DynamicAABBTree broadphase;
+    std::vector<BroadphasePair> collisionPairs;
 
 private:
     // default window settings
     int windowWidth;
     int windowHeight;
+    float nearPlane = 0.1f;
+    float farPlane = 100.0f;
     GLFWmonitor* savedMonitor = nullptr;
     int savedX = 0, savedY = 0, savedWidth = 0, savedHeight = 0;
     bool isFullscreen = false;
@@ -7,9 +7,16 @@
 // define our application
 App app;
 
-int main()
+int main(int argc, char** argv)
 {
     try {
+        // --headless [ticks]: simulation only, no window or GL context
+        if (argc > 1 && std::string(argv[1]) == "--headless") {
+            std::uint64_t ticks = argc > 2 ? std::stoull(argv[2]) : 36000;
+            if (app.initHeadless())
+                return app.runHeadless(ticks);
+            return EXIT_FAILURE;
+        }
         if (app.init())
             return app.run();
     }
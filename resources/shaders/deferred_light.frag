@@ -0,0 +1,133 @@
+#version 460 core
+
+// Lighting of the deferred path from the G-buffer (gbuffer.frag). The
+// ambient and sun pass also writes the scene depth into the target so
+// transparent models and particles are tested against it afterwards;
+// light passes are blended additively on top.
+struct PointLight {
+    vec4 position;   // w = constant
+    vec4 ambient;    // w = linear
+    vec4 diffuse;    // w = quadratic
+    vec4 specular;
+};
+
+struct SpotLight {
+    vec4 position;   // w = cutOff
+    vec4 direction;  // w = outerCutOff
+    vec4 ambient;    // w = constant
+    vec4 diffuse;    // w = linear
+    vec4 specular;   // w = quadratic
+};
+
+layout(std140, binding = 0) uniform LightBlock {
+    vec4 ambientColor;
+    vec4 sunDirection;
+    vec4 sunAmbient;
+    vec4 sunDiffuse;
+    vec4 sunSpecular;
+    ivec4 lightCounts;   // x = point lights, y = spot lights
+};
+layout(std430, binding = 9) readonly buffer PointLightBuffer { PointLight pointLights[]; };
+layout(std430, binding = 10) readonly buffer SpotLightBuffer { SpotLight spotLights[]; };
+
+// sun shadows (CascadedShadows): matrices each cascade was last rendered with
+layout(std140, binding = 2) uniform ShadowBlock {
+    mat4 shadowMatrices[4];
+    vec4 shadowTexels;   // world size of a texel per cascade
+    vec4 shadowParams;   // x = cascades, y = depth bias
+};
+layout(binding = 5) uniform sampler2DArrayShadow shadowMap;
+
+flat in int lightIndex;
+
+out vec4 FragColor;
+
+uniform sampler2D gAlbedo;
+uniform sampler2D gNormal;
+uniform sampler2D gDepth;
+uniform mat4 uInvViewProj;
+uniform vec3 viewPos;
+uniform int lightType;   // 0 = ambient and sun, 1 = point lights, 2 = spot lights
+
+vec3 calculatePhongLighting(vec3 lightDir, vec3 normal, vec3 viewDir, vec3 ambient, vec3 diffuse, vec3 specular, vec3 texColor) {
+    float diff = max(dot(normal, lightDir), 0.0);
+    vec3 reflectDir = reflect(-lightDir, normal);
+    float spec = pow(max(dot(viewDir, reflectDir), 0.0), 32.0);
+    
+    return ambient * texColor + diffuse * diff * texColor + specular * spec * texColor;
+}
+
+vec3 CalcDirLight(vec3 normal, vec3 viewDir, vec3 texColor, float shadow) {
+    vec3 lightDir = normalize(-sunDirection.xyz);
+    return calculatePhongLighting(lightDir, normal, viewDir, sunAmbient.rgb, sunDiffuse.rgb * shadow, sunSpecular.rgb * shadow, texColor);
+}
+
+vec3 CalcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir, vec3 texColor) {
+    vec3 lightDir = normalize(light.position.xyz - fragPos);
+    float distance = length(light.position.xyz - fragPos);
+    float attenuation = 1.0 / (light.position.w + light.ambient.w * distance + light.diffuse.w * distance * distance);
+    
+    vec3 lighting = calculatePhongLighting(lightDir, normal, viewDir, light.ambient.rgb, light.diffuse.rgb, light.specular.rgb, texColor);
+    return lighting * attenuation;
+}
+
+vec3 CalcSpotLight(SpotLight light, vec3 normal, vec3 fragPos, vec3 viewDir, vec3 texColor) {
+    vec3 lightDir = normalize(light.position.xyz - fragPos);
+    float distance = length(light.position.xyz - fragPos);
+    float attenuation = 1.0 / (light.ambient.w + light.diffuse.w * distance + light.specular.w * distance * distance);
+    
+    float theta = dot(lightDir, normalize(-light.direction.xyz));
+    float epsilon = light.position.w - light.direction.w;
+    float intensity = clamp((theta - light.direction.w) / epsilon, 0.0, 1.0);
+    
+    vec3 lighting = calculatePhongLighting(lightDir, normal, viewDir, light.ambient.rgb, light.diffuse.rgb, light.specular.rgb, texColor);
+    return lighting * attenuation * intensity;
+}
+
+// lit fraction from the first cascade that holds the point, 4 filtered taps
+float sunShadow(vec3 fragPos, vec3 normal) {
+    int count = int(shadowParams.x);
+    for (int i = 0; i < count; ++i) {
+        // offset along the normal against acne at grazing sun angles
+        vec4 p = shadowMatrices[i] * vec4(fragPos + normal * shadowTexels[i] * 1.5, 1.0);
+        vec3 coord = p.xyz * 0.5 + 0.5;
+        if (any(lessThan(coord.xy, vec2(0.01))) || any(greaterThan(coord.xy, vec2(0.99))) || coord.z > 1.0) continue;
+        vec2 texel = 1.0 / vec2(textureSize(shadowMap, 0).xy);
+        float lit = 0.0;
+        for (int j = 0; j < 4; ++j) {
+            vec2 offset = (vec2(j & 1, j >> 1) - 0.5) * texel;
+            lit += texture(shadowMap, vec4(coord.xy + offset, float(i), coord.z - shadowParams.y));
+        }
+        return lit * 0.25;
+    }
+    return 1.0;
+}
+
+void main() {
+    ivec2 pixel = ivec2(gl_FragCoord.xy);
+    float depth = texelFetch(gDepth, pixel, 0).r;
+    // background keeps the clear colour
+    if (depth >= 1.0) discard;
+
+    vec3 texColor = texelFetch(gAlbedo, pixel, 0).rgb;
+    vec3 norm = normalize(texelFetch(gNormal, pixel, 0).xyz);
+    // world position from the window position and depth
+    vec2 uv = (vec2(pixel) + 0.5) / vec2(textureSize(gDepth, 0));
+    vec4 world = uInvViewProj * vec4(vec3(uv, depth) * 2.0 - 1.0, 1.0);
+    vec3 fragPos = world.xyz / world.w;
+    vec3 viewDir = normalize(viewPos - fragPos);
+
+    vec3 result;
+    if (lightType == 0) {
+        result = ambientColor.rgb * texColor + CalcDirLight(norm, viewDir, texColor, sunShadow(fragPos, norm));
+    }
+    else if (lightType == 1) {
+        result = CalcPointLight(pointLights[lightIndex], norm, fragPos, viewDir, texColor);
+    }
+    else {
+        result = CalcSpotLight(spotLights[lightIndex], norm, fragPos, viewDir, texColor);
+    }
+
+    FragColor = vec4(result, 1.0);
+    gl_FragDepth = depth;
+}
\ No newline at end of file
@@ -0,0 +1,98 @@
+#version 460 core
+
+// Screen rectangle of one light of the deferred path, drawn as a 4 vertex
+// triangle strip without vertex buffer, one instance per light. The sun and
+// ambient pass covers the whole screen, point and spot lights cover the
+// projected box of the sphere their contribution reaches.
+struct PointLight {
+    vec4 position;   // w = constant
+    vec4 ambient;    // w = linear
+    vec4 diffuse;    // w = quadratic
+    vec4 specular;
+};
+
+struct SpotLight {
+    vec4 position;   // w = cutOff
+    vec4 direction;  // w = outerCutOff
+    vec4 ambient;    // w = constant
+    vec4 diffuse;    // w = linear
+    vec4 specular;   // w = quadratic
+};
+
+layout(std430, binding = 9) readonly buffer PointLightBuffer { PointLight pointLights[]; };
+layout(std430, binding = 10) readonly buffer SpotLightBuffer { SpotLight spotLights[]; };
+
+uniform mat4 uP_m;
+uniform mat4 uV_m;
+uniform int lightType;   // 0 = ambient and sun, 1 = point lights, 2 = spot lights
+
+flat out int lightIndex;
+
+const float INFINITE_RANGE = 1e30;
+
+// distance where the attenuated light drops below 1/256, as LightClusters::range
+float lightRange(vec3 ambient, vec3 diffuse, vec3 specular, float constant, float linear, float quadratic) {
+    vec3 peak = max(ambient, max(diffuse, specular));
+    float k = 256.0 * max(peak.x, max(peak.y, peak.z));
+    if (k <= constant) return 0.0;
+    if (quadratic > 0.0) return (-linear + sqrt(linear * linear - 4.0 * quadratic * (constant - k))) / (2.0 * quadratic);
+    if (linear > 0.0) return (k - constant) / linear;
+    return INFINITE_RANGE;
+}
+
+void main()
+{
+    vec2 corner = vec2(gl_VertexID & 1, gl_VertexID >> 1);
+    lightIndex = gl_InstanceID;
+    vec2 lo = vec2(-1.0);
+    vec2 hi = vec2(1.0);
+
+    if (lightType != 0) {
+        vec3 position;
+        float range;
+        if (lightType == 1) {
+            PointLight light = pointLights[gl_InstanceID];
+            position = light.position.xyz;
+            range = lightRange(light.ambient.rgb, light.diffuse.rgb, light.specular.rgb,
+                light.position.w, light.ambient.w, light.diffuse.w);
+        }
+        else {
+            SpotLight light = spotLights[gl_InstanceID];
+            position = light.position.xyz;
+            range = lightRange(light.ambient.rgb, light.diffuse.rgb, light.specular.rgb,
+                light.ambient.w, light.diffuse.w, light.specular.w);
+        }
+
+        vec3 center = (uV_m * vec4(position, 1.0)).xyz;
+        // unlit or entirely behind the camera: zero area
+        if (range <= 0.0 || center.z - range > 0.0) {
+            gl_Position = vec4(0.0, 0.0, 0.0, 1.0);
+            return;
+        }
+        // a box reaching behind the eye has no finite projection, it keeps the full screen
+        if (range < INFINITE_RANGE) {
+            vec2 boxLo = vec2(1e30);
+            vec2 boxHi = vec2(-1e30);
+            bool behind = false;
+            for (int i = 0; i < 8; ++i) {
+                vec3 offset = vec3(i & 1, (i >> 1) & 1, i >> 2) * 2.0 - 1.0;
+                vec4 clip = uP_m * vec4(center + offset * range, 1.0);
+                if (clip.w <= 1e-4) {
+                    behind = true;
+                    break;
+                }
+                boxLo = min(boxLo, clip.xy / clip.w);
+                boxHi = max(boxHi, clip.xy / clip.w);
+            }
+            if (!behind) {
+                lo = max(boxLo, vec2(-1.0));
+                hi = min(boxHi, vec2(1.0));
+                if (any(greaterThanEqual(lo, hi))) {
+                    gl_Position = vec4(0.0, 0.0, 0.0, 1.0);
+                    return;
+                }
+            }
+        }
+    }
+    gl_Position = vec4(mix(lo, hi, corner), 0.0, 1.0);
+}
\ No newline at end of file
@@ -0,0 +1,6 @@
+#version 460 core
+
+// depth pre-pass with tex.vert, colour writes are masked off
+void main()
+{
+}
\ No newline at end of file
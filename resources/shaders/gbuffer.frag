@@ -0,0 +1,18 @@
+#version 460 core
+
+// G-buffer of the deferred path, lit later by deferred_light.frag
+in VS_OUT {
+    vec3 FragPos;
+    vec3 Normal;
+    vec2 texcoord;
+} fs_in;
+
+layout(location = 0) out vec4 gAlbedo;
+layout(location = 1) out vec4 gNormal;   // world space
+
+uniform sampler2D tex0;
+
+void main() {
+    gAlbedo = vec4(texture(tex0, fs_in.texcoord).rgb, 1.0);
+    gNormal = vec4(normalize(fs_in.Normal), 0.0);
+}
\ No newline at end of file
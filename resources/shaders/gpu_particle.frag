@@ -0,0 +1,26 @@
+#version 460 core
+
+// round sprite, faded out where it gets close to the scene depth
+uniform vec4 color;
+uniform mat4 projection;
+uniform sampler2D sceneDepth;
+uniform float softness;
+
+in vec2 corner;
+in float fade;
+in float viewDistance;
+out vec4 FragColor;
+
+void main()
+{
+    float r2 = dot(corner, corner);
+    if (r2 > 1.0) discard;
+    float shape = (1.0 - r2) * (1.0 - r2);
+
+    // linear distance of the opaque scene behind this pixel
+    float depth = texelFetch(sceneDepth, ivec2(gl_FragCoord.xy), 0).r;
+    float sceneDistance = projection[3][2] / (depth * 2.0 - 1.0 + projection[2][2]);
+    float soft = clamp((sceneDistance - viewDistance) / softness, 0.0, 1.0);
+
+    FragColor = vec4(color.rgb, color.a * fade * shape * soft);
+}
\ No newline at end of file
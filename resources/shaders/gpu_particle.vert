@@ -0,0 +1,36 @@
+#version 460 core
+
+// camera facing quad per instance, instances follow the far to near order
+struct Particle {
+    vec4 position;   // xyz, w = remaining life
+    vec4 velocity;   // xyz, w = total life
+};
+
+layout(std430, binding = 0) readonly buffer ParticleBuffer { Particle particles[]; };
+layout(std430, binding = 5) readonly buffer SortBuffer { uvec2 entries[]; };
+
+uniform mat4 projection;
+uniform mat4 view;
+uniform float size;
+
+out vec2 corner;
+out float fade;
+out float viewDistance;
+
+const vec2 corners[4] = vec2[](vec2(-1.0, -1.0), vec2(1.0, -1.0), vec2(-1.0, 1.0), vec2(1.0, 1.0));
+
+void main()
+{
+    Particle p = particles[entries[gl_InstanceID].y];
+    corner = corners[gl_VertexID];
+    fade = clamp(p.position.w / max(p.velocity.w, 1e-4), 0.0, 1.0);
+
+    // camera axes are the rows of the view rotation
+    vec3 right = vec3(view[0][0], view[1][0], view[2][0]);
+    vec3 up = vec3(view[0][1], view[1][1], view[2][1]);
+    float radius = size * (0.5 + 0.5 * fade);
+    vec4 viewPosition = view * vec4(p.position.xyz + (right * corner.x + up * corner.y) * radius, 1.0);
+
+    viewDistance = -viewPosition.z;
+    gl_Position = projection * viewPosition;
+}
\ No newline at end of file
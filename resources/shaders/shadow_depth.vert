@@ -0,0 +1,12 @@
+#version 460 core
+
+// caster depth of one shadow cascade (CascadedShadows)
+layout(location = 0) in vec3 aPos;
+
+uniform mat4 uLightVP;
+uniform mat4 uM_m;
+
+void main()
+{
+    gl_Position = uLightVP * uM_m * vec4(aPos, 1.0);
+}
\ No newline at end of file
@@ -1,41 +1,47 @@
 #version 460 core
 
-#define MAX_POINT_LIGHTS 15
-#define MAX_SPOT_LIGHTS 15
-
-struct AmbientLight {
-    vec3 color;
+// scene lights, shared by every program through fixed binding points (LightBuffer)
+struct PointLight {
+    vec4 position;   // w = constant
+    vec4 ambient;    // w = linear
+    vec4 diffuse;    // w = quadratic
+    vec4 specular;
 };
 
-struct DirectionalLight {
-    vec3 direction;
-    vec3 ambient;
-    vec3 diffuse;
-    vec3 specular;
+struct SpotLight {
+    vec4 position;   // w = cutOff
+    vec4 direction;  // w = outerCutOff
+    vec4 ambient;    // w = constant
+    vec4 diffuse;    // w = linear
+    vec4 specular;   // w = quadratic
 };
 
-struct PointLight {
-    vec3 position;
-    vec3 ambient;
-    vec3 diffuse;
-    vec3 specular;
-    float constant;
-    float linear;
-    float quadratic;
+layout(std140, binding = 0) uniform LightBlock {
+    vec4 ambientColor;
+    vec4 sunDirection;
+    vec4 sunAmbient;
+    vec4 sunDiffuse;
+    vec4 sunSpecular;
+    ivec4 lightCounts;   // x = point lights, y = spot lights
 };
+layout(std430, binding = 9) readonly buffer PointLightBuffer { PointLight pointLights[]; };
+layout(std430, binding = 10) readonly buffer SpotLightBuffer { SpotLight spotLights[]; };
 
-struct SpotLight {
-    vec3 position;
-    vec3 direction;
-    float cutOff;
-    float outerCutOff;
-    vec3 ambient;
-    vec3 diffuse;
-    vec3 specular;
-    float constant;
-    float linear;
-    float quadratic;
+// clustered light lists (LightClusters): x = first index, y = point lights, z = spot lights
+layout(std140, binding = 1) uniform ClusterBlock {
+    uvec4 clusterGrid;   // tiles x, y, depth slices, tile size in pixels
+    vec4 clusterDepth;   // near, far, slice scale, slice bias
+};
+layout(std430, binding = 11) readonly buffer ClusterGrid { uvec4 clusters[]; };
+layout(std430, binding = 12) readonly buffer ClusterIndices { uint lightIndices[]; };
+
+// sun shadows (CascadedShadows): matrices each cascade was last rendered with
+layout(std140, binding = 2) uniform ShadowBlock {
+    mat4 shadowMatrices[4];
+    vec4 shadowTexels;   // world size of a texel per cascade
+    vec4 shadowParams;   // x = cascades, y = depth bias
 };
+layout(binding = 5) uniform sampler2DArrayShadow shadowMap;
 
 in VS_OUT {
     vec3 FragPos;
@@ -48,13 +54,6 @@ out vec4 FragColor;
 uniform sampler2D tex0;
 uniform vec3 viewPos;
 
-uniform AmbientLight ambientLight;
-uniform DirectionalLight dirLights[1];
-uniform int numPointLights;
-uniform PointLight pointLights[MAX_POINT_LIGHTS];
-uniform int numSpotLights;
-uniform SpotLight spotLights[MAX_SPOT_LIGHTS];
-
 vec3 calculatePhongLighting(vec3 lightDir, vec3 normal, vec3 viewDir, vec3 ambient, vec3 diffuse, vec3 specular, vec3 texColor) {
     float diff = max(dot(normal, lightDir), 0.0);
     vec3 reflectDir = reflect(-lightDir, normal);
@@ -63,33 +62,62 @@ vec3 calculatePhongLighting(vec3 lightDir, vec3 normal, vec3 viewDir, vec3 ambie
     return ambient * texColor + diffuse * diff * texColor + specular * spec * texColor;
 }
 
-vec3 CalcDirLight(DirectionalLight light, vec3 normal, vec3 viewDir, vec3 texColor) {
-    vec3 lightDir = normalize(-light.direction);
-    return calculatePhongLighting(lightDir, normal, viewDir, light.ambient, light.diffuse, light.specular, texColor);
+vec3 CalcDirLight(vec3 normal, vec3 viewDir, vec3 texColor, float shadow) {
+    vec3 lightDir = normalize(-sunDirection.xyz);
+    return calculatePhongLighting(lightDir, normal, viewDir, sunAmbient.rgb, sunDiffuse.rgb * shadow, sunSpecular.rgb * shadow, texColor);
 }
 
 vec3 CalcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir, vec3 texColor) {
-    vec3 lightDir = normalize(light.position - fragPos);
-    float distance = length(light.position - fragPos);
-    float attenuation = 1.0 / (light.constant + light.linear * distance + light.quadratic * distance * distance);
+    vec3 lightDir = normalize(light.position.xyz - fragPos);
+    float distance = length(light.position.xyz - fragPos);
+    float attenuation = 1.0 / (light.position.w + light.ambient.w * distance + light.diffuse.w * distance * distance);
     
-    vec3 lighting = calculatePhongLighting(lightDir, normal, viewDir, light.ambient, light.diffuse, light.specular, texColor);
+    vec3 lighting = calculatePhongLighting(lightDir, normal, viewDir, light.ambient.rgb, light.diffuse.rgb, light.specular.rgb, texColor);
     return lighting * attenuation;
 }
 
 vec3 CalcSpotLight(SpotLight light, vec3 normal, vec3 fragPos, vec3 viewDir, vec3 texColor) {
-    vec3 lightDir = normalize(light.position - fragPos);
-    float distance = length(light.position - fragPos);
-    float attenuation = 1.0 / (light.constant + light.linear * distance + light.quadratic * distance * distance);
+    vec3 lightDir = normalize(light.position.xyz - fragPos);
+    float distance = length(light.position.xyz - fragPos);
+    float attenuation = 1.0 / (light.ambient.w + light.diffuse.w * distance + light.specular.w * distance * distance);
     
-    float theta = dot(lightDir, normalize(-light.direction));
-    float epsilon = light.cutOff - light.outerCutOff;
-    float intensity = clamp((theta - light.outerCutOff) / epsilon, 0.0, 1.0);
+    float theta = dot(lightDir, normalize(-light.direction.xyz));
+    float epsilon = light.position.w - light.direction.w;
+    float intensity = clamp((theta - light.direction.w) / epsilon, 0.0, 1.0);
     
-    vec3 lighting = calculatePhongLighting(lightDir, normal, viewDir, light.ambient, light.diffuse, light.specular, texColor);
+    vec3 lighting = calculatePhongLighting(lightDir, normal, viewDir, light.ambient.rgb, light.diffuse.rgb, light.specular.rgb, texColor);
     return lighting * attenuation * intensity;
 }
 
+// lit fraction from the first cascade that holds the point, 4 filtered taps
+float sunShadow(vec3 fragPos, vec3 normal) {
+    int count = int(shadowParams.x);
+    for (int i = 0; i < count; ++i) {
+        // offset along the normal against acne at grazing sun angles
+        vec4 p = shadowMatrices[i] * vec4(fragPos + normal * shadowTexels[i] * 1.5, 1.0);
+        vec3 coord = p.xyz * 0.5 + 0.5;
+        if (any(lessThan(coord.xy, vec2(0.01))) || any(greaterThan(coord.xy, vec2(0.99))) || coord.z > 1.0) continue;
+        vec2 texel = 1.0 / vec2(textureSize(shadowMap, 0).xy);
+        float lit = 0.0;
+        for (int j = 0; j < 4; ++j) {
+            vec2 offset = (vec2(j & 1, j >> 1) - 0.5) * texel;
+            lit += texture(shadowMap, vec4(coord.xy + offset, float(i), coord.z - shadowParams.y));
+        }
+        return lit * 0.25;
+    }
+    return 1.0;
+}
+
+// tile from the window position, depth slice from the linearized depth
+uint clusterIndex() {
+    float n = clusterDepth.x;
+    float f = clusterDepth.y;
+    float depth = 2.0 * n * f / (f + n - (gl_FragCoord.z * 2.0 - 1.0) * (f - n));
+    uint slice = uint(clamp(floor(log(depth) * clusterDepth.z + clusterDepth.w), 0.0, float(clusterGrid.z - 1u)));
+    uvec2 tile = min(uvec2(gl_FragCoord.xy) / clusterGrid.w, clusterGrid.xy - 1u);
+    return tile.x + clusterGrid.x * (tile.y + clusterGrid.y * slice);
+}
+
 void main() {
     vec3 norm = normalize(fs_in.Normal);
     vec3 viewDir = normalize(viewPos - fs_in.FragPos);
@@ -97,19 +125,22 @@ void main() {
     vec3 texColor = texSample.rgb;
     float alpha = texSample.a;
 
-    vec3 result = ambientLight.color * texColor;
+    vec3 result = ambientColor.rgb * texColor;
 
-    result += CalcDirLight(dirLights[0], norm, viewDir, texColor);
+    result += CalcDirLight(norm, viewDir, texColor, sunShadow(fs_in.FragPos, norm));
 
-    int i = 0;
-    while (i < numPointLights) {
-        result += CalcPointLight(pointLights[i], norm, fs_in.FragPos, viewDir, texColor);
+    // only the lights whose range reaches this cluster
+    uvec4 cluster = clusters[clusterIndex()];
+    uint i = cluster.x;
+    uint pointEnd = cluster.x + cluster.y;
+    while (i < pointEnd) {
+        result += CalcPointLight(pointLights[lightIndices[i]], norm, fs_in.FragPos, viewDir, texColor);
         i++;
     }
 
-    i = 0;
-    while (i < numSpotLights) {
-        result += CalcSpotLight(spotLights[i], norm, fs_in.FragPos, viewDir, texColor);
+    uint spotEnd = pointEnd + cluster.z;
+    while (i < spotEnd) {
+        result += CalcSpotLight(spotLights[lightIndices[i]], norm, fs_in.FragPos, viewDir, texColor);
         i++;
     }
 
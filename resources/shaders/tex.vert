@@ -8,17 +8,38 @@ uniform mat4 uP_m;
 uniform mat4 uV_m;
 uniform mat4 uM_m;
 
+// instanced draws take their matrices from the instance buffer
+struct Instance {
+    mat4 model;
+    mat4 normal;
+};
+layout(std430, binding = 8) readonly buffer InstanceBuffer { Instance instances[]; };
+uniform int uInstanced;
+
 out VS_OUT {
     vec3 FragPos;
     vec3 Normal;
     vec2 texcoord;
 } vs_out;
 
+// the depth pre-pass and the shading pass must produce identical depth
+invariant gl_Position;
+
 void main()
 {
-    vec4 worldPos = uM_m * vec4(aPos, 1.0);
+    mat4 model = uM_m;
+    mat3 normalMatrix;
+    if (uInstanced != 0) {
+        Instance instance = instances[gl_BaseInstance + gl_InstanceID];
+        model = instance.model;
+        normalMatrix = mat3(instance.normal);
+    }
+    else {
+        normalMatrix = mat3(transpose(inverse(uM_m)));
+    }
+    vec4 worldPos = model * vec4(aPos, 1.0);
     vs_out.FragPos = worldPos.xyz;
-    vs_out.Normal = mat3(transpose(inverse(uM_m))) * aNorm;
+    vs_out.Normal = normalMatrix * aNorm;
     vs_out.texcoord = aTex;
     gl_Position = uP_m * uV_m * worldPos;
 }
\ No newline at end of file